@@ -0,0 +1,97 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#include "arc_replacer.h"
+
+#include <algorithm>
+
+namespace storage {
+ARCReplacer::ARCReplacer(size_t pool_size) : capacity_(static_cast<int>(pool_size)),
+                                             lists_(static_cast<int>(pool_size), 2),
+                                             evictable_(pool_size, 0),
+                                             pages_(pool_size, INVALID_PAGE_ID),
+                                             b1_(pool_size), b2_(pool_size) {
+}
+auto ARCReplacer::Evict(frame_id_t *frame_id) -> bool {
+  if (size_ == 0) {
+    return false;
+  }
+  int list = lists_.Size(kT1) > 0 && lists_.Size(kT1) > p_ ? kT1 : kT2;
+  frame_id_t victim = FirstEvictable(list);
+  if (victim == IntrusiveLists::kNone) {
+    list = 1 - list;
+    victim = FirstEvictable(list);
+  }
+  (list == kT1 ? b1_ : b2_).Push(pages_[victim]);
+  Remove(victim);
+  *frame_id = victim;
+  return true;
+}
+auto ARCReplacer::RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void {
+  if (lists_.Contains(frame_id)) {
+    lists_.Erase(frame_id);
+    lists_.PushBack(kT2, frame_id);
+    return;
+  }
+  pages_[frame_id] = page_id;
+  int b1_size = b1_.Size(), b2_size = b2_.Size();
+  if (b1_.Erase(page_id)) {
+    p_ = std::min(capacity_, p_ + std::max(1, b2_size / b1_size));
+    lists_.PushBack(kT2, frame_id);
+  } else if (b2_.Erase(page_id)) {
+    p_ = std::max(0, p_ - std::max(1, b1_size / b2_size));
+    lists_.PushBack(kT2, frame_id);
+  } else {
+    lists_.PushBack(kT1, frame_id);
+    // keep |T1| + |B1| <= c, so that B1 only remembers what T1 could have held
+    while (lists_.Size(kT1) + b1_.Size() > capacity_ && b1_.Size() > 0) {
+      b1_.PopOldest();
+    }
+  }
+}
+void ARCReplacer::SetEvictable(frame_id_t frame_id) {
+  if (!evictable_[frame_id]) {
+    evictable_[frame_id] = 1;
+    ++size_;
+  }
+  if (lists_.Contains(frame_id) && lists_.Parked(frame_id)) {
+    lists_.Unpark(frame_id);
+  }
+}
+void ARCReplacer::SetNonevictable(frame_id_t frame_id) {
+  if (evictable_[frame_id]) {
+    evictable_[frame_id] = 0;
+    --size_;
+  }
+}
+void ARCReplacer::Remove(frame_id_t frame_id) {
+  SetNonevictable(frame_id);
+  if (lists_.Contains(frame_id)) {
+    lists_.Erase(frame_id);
+  }
+}
+auto ARCReplacer::Size() const -> size_t {
+  return size_;
+}
+void ARCReplacer::Coldest(size_t n, std::vector<frame_id_t> *frames) const {
+  int first = lists_.Size(kT1) > p_ ? kT1 : kT2;
+  for (int list : {first, 1 - first}) {
+    for (frame_id_t it = lists_.Front(list); it != IntrusiveLists::kNone && n > 0; it = lists_.Next(it)) {
+      if (evictable_[it]) {
+        frames->push_back(it);
+        --n;
+      }
+    }
+  }
+}
+auto ARCReplacer::FirstEvictable(int list) -> frame_id_t {
+  // a pinned frame met at the front is parked until it is unpinned, so that no evict passes it again
+  frame_id_t it = lists_.Front(list);
+  while (it != IntrusiveLists::kNone && !evictable_[it]) {
+    lists_.Park(it);
+    it = lists_.Front(list);
+  }
+  return it;
+}
+} // namespace storage
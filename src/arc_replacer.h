@@ -0,0 +1,55 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#pragma once
+#include <config.h>
+#include <cstdint>
+#include <vector>
+
+#include "replacer_lists.h"
+
+namespace storage {
+/**
+ * @brief ARC, adaptive replacement cache (Megiddo & Modha).
+ *
+ * Cached pages are split between T1 (seen once recently) and T2 (seen at least twice), both LRU lists;
+ * the ghost lists B1 and B2 remember the pages recently evicted from each. The target size `p_` of T1 adapts:
+ * a miss on a page in B1 means T1 was too small, a miss on a page in B2 means T2 was.
+ * T1 is evicted from while it is larger than the target, T2 otherwise.
+ */
+class ARCReplacer {
+  public:
+    using frame_id_t = int;
+    explicit ARCReplacer(size_t pool_size);
+
+    auto Evict(frame_id_t *frame_id) -> bool;
+
+    auto RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void;
+
+    void SetEvictable(frame_id_t frame_id);
+
+    void SetNonevictable(frame_id_t frame_id);
+
+    void Remove(frame_id_t frame_id);
+
+    auto Size() const -> size_t;
+
+    /// @brief Append up to `n` evictable frames, roughly in the order they would be evicted
+    void Coldest(size_t n, std::vector<frame_id_t> *frames) const;
+
+  private:
+    static constexpr int kT1 = 0;
+    static constexpr int kT2 = 1;
+    const int capacity_;
+    int p_ = 0; // target size of T1
+    size_t size_ = 0;
+    IntrusiveLists lists_; // T1 and T2, every cached frame, least recent first; pinned ones may be parked
+    std::vector<uint8_t> evictable_;
+    std::vector<page_id_t> pages_;
+    GhostList b1_;
+    GhostList b2_;
+
+    auto FirstEvictable(int list) -> frame_id_t;
+};
+} // namespace storage
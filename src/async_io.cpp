@@ -0,0 +1,239 @@
+//
+// Created by zj on 6/2/2024.
+//
+
+#include "async_io.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace storage {
+auto AsyncIO::Create(int fd, AsyncIOBackend backend) -> std::unique_ptr<AsyncIO> {
+  switch (backend) {
+    case AsyncIOBackend::NONE: return nullptr;
+    case AsyncIOBackend::IO_URING:
+      try {
+        return std::make_unique<IOUringIO>(fd);
+      } catch (std::runtime_error &) {
+        // e.g. old kernels or seccomp profiles that block io_uring
+        return std::make_unique<ThreadPoolIO>(fd);
+      }
+    case AsyncIOBackend::THREAD_POOL: return std::make_unique<ThreadPoolIO>(fd);
+  }
+  return nullptr;
+}
+
+IOUringIO::IOUringIO(int fd) : fd_(fd) {
+  io_uring_params params{};
+  ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, ASYNC_IO_QUEUE_DEPTH, &params));
+  if (ring_fd_ < 0) {
+    throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+  }
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = single_mmap
+               ? sq_ring_
+               : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_CQ_RING);
+  sqes_count_ = params.sq_entries;
+  void *sqes = mmap(nullptr, sqes_count_ * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+    close(ring_fd_);
+    throw std::runtime_error("Cannot map io_uring");
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+  auto sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  auto cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+IOUringIO::~IOUringIO() {
+  Submit();
+  while (in_flight_ > 0) {
+    Enter(1);
+    Collect(&completed_);
+  }
+  munmap(sqes_, sqes_count_ * sizeof(io_uring_sqe));
+  if (cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+  munmap(sq_ring_, sq_ring_size_);
+  close(ring_fd_);
+}
+void IOUringIO::Read(size_t offset, char *data, size_t size, tag_t tag) {
+  Queue(IORING_OP_READ, offset, data, size, tag);
+}
+void IOUringIO::Write(size_t offset, const char *data, size_t size, tag_t tag) {
+  Queue(IORING_OP_WRITE, offset, data, size, tag);
+}
+void IOUringIO::Queue(uint8_t opcode, size_t offset, const char *data, size_t size, tag_t tag) {
+  while (in_flight_ + to_submit_ >= sqes_count_) {
+    // the ring is full: start what is queued and wait for a slot
+    Enter(1);
+    Collect(&completed_);
+  }
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & *sq_mask_;
+  io_uring_sqe &sqe = sqes_[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = opcode;
+  sqe.fd = fd_;
+  sqe.off = offset;
+  sqe.addr = reinterpret_cast<uint64_t>(data);
+  sqe.len = size;
+  sqe.user_data = tag;
+  if (opcode == IORING_OP_WRITE) write_sizes_[tag] = size;
+  sq_array_[index] = index;
+  std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+  ++to_submit_;
+  ++pending_;
+}
+void IOUringIO::Submit() {
+  if (to_submit_ > 0) Enter(0);
+}
+void IOUringIO::Enter(unsigned min_complete) {
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int ret;
+  do {
+    ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit_, min_complete, flags, nullptr, 0));
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+  }
+  in_flight_ += ret;
+  to_submit_ -= ret;
+}
+void IOUringIO::Collect(std::vector<tag_t> *tags) {
+  unsigned head = *cq_head_;
+  unsigned tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+  for (; head != tail; ++head) {
+    const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+    --in_flight_;
+    // short reads are fine: frames past the end of the file were never written and read as zeros
+    std::string error = cqe.res < 0 ? strerror(-cqe.res) : "";
+    if (auto write = write_sizes_.find(cqe.user_data); write != write_sizes_.end()) {
+      // a short write, e.g. out of space part way through the frame, loses the rest of it all the same
+      if (cqe.res >= 0 && static_cast<unsigned>(cqe.res) != write->second) error = "short write";
+      write_sizes_.erase(write);
+    }
+    if (!error.empty()) {
+      // consumed first, so that the destructor does not report it again
+      std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+      throw std::runtime_error("Asynchronous I/O failed: " + error);
+    }
+    tags->push_back(cqe.user_data);
+  }
+  std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+}
+void IOUringIO::Reap(std::vector<tag_t> *tags, bool wait) {
+  Submit();
+  auto reaped = tags->size();
+  tags->insert(tags->end(), completed_.begin(), completed_.end());
+  completed_.clear();
+  Collect(tags);
+  if (wait && tags->size() == reaped && in_flight_ > 0) {
+    Enter(1);
+    Collect(tags);
+  }
+  pending_ -= tags->size() - reaped;
+}
+
+ThreadPoolIO::ThreadPoolIO(int fd) : fd_(fd) {
+  for (int i = 0; i < ASYNC_IO_THREADS; ++i) {
+    workers_.emplace_back(&ThreadPoolIO::Work, this);
+  }
+}
+ThreadPoolIO::~ThreadPoolIO() {
+  Submit();
+  {
+    std::unique_lock lock(latch_);
+    stop_ = true;
+  }
+  request_cv_.notify_all();
+  for (auto &worker : workers_) worker.join();
+}
+void ThreadPoolIO::Read(size_t offset, char *data, size_t size, tag_t tag) {
+  queued_.push_back({false, offset, data, size, tag});
+  ++pending_;
+}
+void ThreadPoolIO::Write(size_t offset, const char *data, size_t size, tag_t tag) {
+  queued_.push_back({true, offset, const_cast<char *>(data), size, tag});
+  ++pending_;
+}
+void ThreadPoolIO::Submit() {
+  if (queued_.empty()) return;
+  {
+    std::unique_lock lock(latch_);
+    // keep at most ASYNC_IO_QUEUE_DEPTH requests handed to the workers
+    complete_cv_.wait(lock, [this] {
+      return static_cast<int>(requests_.size() + queued_.size()) <= ASYNC_IO_QUEUE_DEPTH || requests_.empty();
+    });
+    requests_.insert(requests_.end(), queued_.begin(), queued_.end());
+  }
+  queued_.clear();
+  request_cv_.notify_all();
+}
+void ThreadPoolIO::Reap(std::vector<tag_t> *tags, bool wait) {
+  Submit();
+  std::unique_lock lock(latch_);
+  if (wait && pending_ > 0) {
+    complete_cv_.wait(lock, [this] { return !completed_.empty() || !error_.empty(); });
+  }
+  if (!error_.empty()) {
+    throw std::runtime_error(error_);
+  }
+  pending_ -= completed_.size();
+  tags->insert(tags->end(), completed_.begin(), completed_.end());
+  completed_.clear();
+}
+void ThreadPoolIO::Work() {
+  while (true) {
+    Request request{};
+    {
+      std::unique_lock lock(latch_);
+      request_cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+      if (requests_.empty()) return;
+      request = requests_.front();
+      requests_.pop_front();
+    }
+    size_t done = 0;
+    while (done < request.size) {
+      ssize_t ret = request.write
+                      ? pwrite(fd_, request.data + done, request.size - done, request.offset + done)
+                      : pread(fd_, request.data + done, request.size - done, request.offset + done);
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) break; // ret == 0: read past the end of the file
+      done += ret;
+    }
+    int error = errno;
+    {
+      std::unique_lock lock(latch_);
+      if (done < request.size && request.write) {
+        // reported by the next Reap, as exceptions cannot cross threads
+        error_ = "Asynchronous I/O failed: " + std::string(strerror(error));
+      }
+      completed_.push_back(request.tag);
+    }
+    complete_cv_.notify_all();
+  }
+}
+} // namespace storage
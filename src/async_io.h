@@ -0,0 +1,112 @@
+//
+// Created by zj on 6/2/2024.
+//
+
+#pragma once
+
+#include <config.h>
+#include <linux/io_uring.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace storage {
+/**
+ * @brief Asynchronous positioned reads and writes on a file descriptor.
+ *
+ * Requests are identified by a caller-chosen tag. Queued requests start on `Submit`, and the tags of
+ * finished requests are collected by `Reap`. The buffer of a request must stay untouched until its tag is reaped.
+ * At most `ASYNC_IO_QUEUE_DEPTH` requests are in flight; queuing more blocks until one finishes.
+ */
+class AsyncIO {
+  public:
+    using tag_t = uint64_t;
+
+    /// @brief IO_URING falls back to THREAD_POOL if io_uring is unavailable, NONE returns nullptr
+    static auto Create(int fd, AsyncIOBackend backend) -> std::unique_ptr<AsyncIO>;
+
+    virtual ~AsyncIO() = default;
+    virtual void Read(size_t offset, char *data, size_t size, tag_t tag) = 0;
+    virtual void Write(size_t offset, const char *data, size_t size, tag_t tag) = 0;
+    virtual void Submit() = 0;
+    /// @brief Append the tags of finished requests to `tags`, block until there is at least one if `wait`
+    virtual void Reap(std::vector<tag_t> *tags, bool wait) = 0;
+    /// @brief Number of requests queued or in flight whose tags have not been reaped
+    auto Pending() const -> int { return pending_; }
+
+  protected:
+    int pending_ = 0;
+};
+
+/// @brief io_uring driven directly through the syscalls, so that liburing is not needed.
+class IOUringIO : public AsyncIO {
+  public:
+    /// @throw std::runtime_error if the ring cannot be set up
+    explicit IOUringIO(int fd);
+    ~IOUringIO() override;
+    void Read(size_t offset, char *data, size_t size, tag_t tag) override;
+    void Write(size_t offset, const char *data, size_t size, tag_t tag) override;
+    void Submit() override;
+    void Reap(std::vector<tag_t> *tags, bool wait) override;
+
+  private:
+    int fd_;
+    int ring_fd_ = -1;
+    unsigned to_submit_ = 0;
+    int in_flight_ = 0; // submitted to the kernel and not completed
+    std::vector<tag_t> completed_; // completions collected while waiting for a free slot
+    std::unordered_map<tag_t, unsigned> write_sizes_; // of the writes in flight; a tag has one request at a time
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    unsigned sqes_count_ = 0;
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_cqe *cqes_;
+
+    void Queue(uint8_t opcode, size_t offset, const char *data, size_t size, tag_t tag);
+    void Enter(unsigned min_complete);
+    void Collect(std::vector<tag_t> *tags);
+};
+
+/// @brief pread / pwrite on `ASYNC_IO_THREADS` worker threads.
+class ThreadPoolIO : public AsyncIO {
+  public:
+    explicit ThreadPoolIO(int fd);
+    ~ThreadPoolIO() override;
+    void Read(size_t offset, char *data, size_t size, tag_t tag) override;
+    void Write(size_t offset, const char *data, size_t size, tag_t tag) override;
+    void Submit() override;
+    void Reap(std::vector<tag_t> *tags, bool wait) override;
+
+  private:
+    struct Request {
+      bool write;
+      size_t offset;
+      char *data;
+      size_t size;
+      tag_t tag;
+    };
+    int fd_;
+    bool stop_ = false;
+    std::vector<Request> queued_; // not yet submitted, only touched by the caller
+    std::mutex latch_;
+    std::condition_variable request_cv_;
+    std::condition_variable complete_cv_;
+    std::deque<Request> requests_;
+    std::vector<tag_t> completed_;
+    std::string error_; // set by a worker whose write failed
+    std::vector<std::thread> workers_;
+
+    void Work();
+};
+} // namespace storage
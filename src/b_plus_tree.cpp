@@ -6,45 +6,73 @@
 #include "b_plus_tree.h"
 
 namespace storage {
-template<typename KeyType, typename ValueType>
-BPlusTree<KeyType, ValueType>::BPlusTree(BufferPoolManager<PagesPerFrame> *bpm, page_id_t &root_page_id, bool reset)
-  : bpm_(bpm), root_page_id_(root_page_id) {
-  static_assert(sizeof(InternalFrame) <= Frame<PagesPerFrame>::kFrameSize);
-  static_assert(sizeof(LeafFrame) <= Frame<PagesPerFrame>::kFrameSize);
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::BPlusTree(BufferPoolManager<PagesPerFrame> *bpm,
+                                         page_id_t &root_page_id,
+                                         bool reset,
+                                         int pinned_levels,
+                                         bool concurrent)
+  : bpm_(bpm), root_page_id_(root_page_id), concurrent_(concurrent), pinned_levels_(pinned_levels),
+    swizzled_slots_(pinned_levels > 0 ? bpm->PinBudget() : 0) {
+  static_assert(sizeof(InternalFrame) <= Frame<PagesPerFrame>::kDataSize);
+  static_assert(sizeof(LeafFrame) <= Frame<PagesPerFrame>::kDataSize);
+  if (concurrent && !bpm->Concurrent()) {
+    throw std::runtime_error("A concurrent B+ tree requires a concurrent buffer pool");
+  }
   if (reset) root_page_id = INVALID_PAGE_ID;
+  if (concurrent && pinned_levels > 0) SwizzleTier(); // shared descents do not build the tier
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SharedLatch() -> std::shared_lock<std::shared_mutex> {
+  if (!concurrent_) return {};
+  std::lock_guard gate(writer_gate_); // wait for the exclusive sections that are already waiting
+  return std::shared_lock(latch_);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::CreateRootFrame() -> BasicFrameGuard {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::UpdateLeaf(const KeyType &key,
+                                                                      auto update) -> std::optional<bool> {
+  auto lock = SharedLatch();
+  auto ctx = FindLeafFrame(key);
+  if (ctx.stack_.empty()) {
+    return std::nullopt;
+  }
+  auto &guard = ctx.current_frame_;
+  guard.WriteLock();
+  auto leaf = guard.template As<LeafFrame>();
+  auto index = KeyIndex(key, leaf) - 1; // the descent read the leaf before it was latched
+  ctx.stack_.back() = {guard.PageId(), index};
+  auto result = update(ctx, leaf, index > 0 && leaf->KeyAt(index) == key);
+  guard.WriteUnlock();
+  return result;
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::CreateRootFrame() -> BasicFrameGuard {
   auto root_frame_guard = bpm_->NewFrameGuarded(&root_page_id_);
-  auto root_frame = root_frame_guard.AsMut<LeafFrame>();
+  auto root_frame = root_frame_guard.template AsMut<LeafFrame>();
   root_frame->Init();
   return root_frame_guard;
 }
 
-template<typename KeyType, typename ValueType>
-void BPlusTree<KeyType, ValueType>::InsertInLeaf(const KeyType &key,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertInLeaf(const KeyType &key,
                                                  const ValueType &value,
-                                                 typename ::storage::BPlusTree<KeyType, ValueType>::Context &ctx) {
+                                                 typename ::storage::BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Context &ctx) {
   auto leaf = ctx.current_frame_.template AsMut<LeafFrame>();
-  if (leaf->GetSize() < LeafFrame::GetMaxSize()) {
+  if (leaf->CanInsert(key)) {
     InsertInLeafPlain(key, value, ctx);
   } else {
     // split
     auto old_page_id = ctx.stack_.back().PageId();
     auto new_leaf_guard = bpm_->NewFrameGuarded();
     page_id_t new_leaf_id = new_leaf_guard.PageId();
-    auto new_leaf = new_leaf_guard.AsMut<LeafFrame>();
+    auto new_leaf = new_leaf_guard.template AsMut<LeafFrame>();
     new_leaf->Init();
-    auto split_index = (leaf->GetSize() + 1) / 2;
+    auto split_index = leaf->SplitIndex();
     bool left = key < leaf->KeyAt(split_index);
     if (left) {
       --split_index;
     }
-    size_t move_count = (leaf->GetSize() - split_index);
-    std::memcpy(new_leaf->Keys() + 1, leaf->Keys() + split_index + 1, move_count * sizeof(KeyType));
-    std::memcpy(new_leaf->Values() + 1, leaf->Values() + split_index + 1, move_count * sizeof(ValueType));
-    new_leaf->SetSize(move_count);
-    leaf->SetSize(split_index);
+    leaf->MoveTo(split_index + 1, new_leaf);
     new_leaf->SetNextPageId(leaf->GetNextPageId());
     leaf->SetNextPageId(new_leaf_id);
     if (left) {
@@ -61,8 +89,23 @@ void BPlusTree<KeyType, ValueType>::InsertInLeaf(const KeyType &key,
     InsertInParent(old_page_id, new_leaf->KeyAt(1), new_leaf_id, ctx);
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::Insert(const KeyType &key, const ValueType &value) -> bool {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Insert(const KeyType &key, const ValueType &value) -> bool {
+  if (concurrent_) {
+    auto inserted = UpdateLeaf(key, [&](Context &ctx, const LeafFrame *leaf, bool found) -> std::optional<bool> {
+      if (found) return false;
+      if (!leaf->CanInsert(key)) return std::nullopt;
+      InsertInLeafPlain(key, value, ctx);
+      return true;
+    });
+    if (inserted) return *inserted;
+  }
+  ExclusiveSection section(this);
+  return InsertImpl(key, value);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertImpl(const KeyType &key,
+                                                                      const ValueType &value) -> bool {
   Context ctx = FindLeafFrame(key);
   if (ctx.stack_.empty()) {
     ctx.current_frame_ = CreateRootFrame();
@@ -70,16 +113,101 @@ auto BPlusTree<KeyType, ValueType>::Insert(const KeyType &key, const ValueType &
     ctx.stack_.emplace_back(ctx.root_page_id_, 0);
   } else {
     auto leaf = ctx.current_frame_.template As<LeafFrame>();
-    if (ctx.stack_.back().Index() <= leaf->GetSize() &&
-      leaf->KeyAt(ctx.stack_.back().Index()) == key) {
+    auto index = ctx.stack_.back().Index();
+    if (0 < index && index <= leaf->GetSize() && leaf->KeyAt(index) == key) {
       return false;
     }
   }
   InsertInLeaf(key, value, ctx);
   return true;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::GetOrEmplace(const KeyType &key, auto value_generator, ValueType *value) -> bool {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+template<std::forward_iterator It>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::BulkLoad(It first, It last, double fill_factor) {
+  ExclusiveSection section(this);
+  if (!Empty()) {
+    throw std::runtime_error("BulkLoad requires an empty tree");
+  }
+  auto capacity = [fill_factor](size_t min_size, size_t max_size) {
+    return std::clamp(static_cast<size_t>(fill_factor * max_size), min_size, max_size);
+  };
+  if (first == last) return;
+  std::vector<std::pair<KeyType, page_id_t> > level; // the first key and the page of every frame of a level
+  // leaves are filled one after another, their capacity depends on the keys for packed leaves
+  BasicFrameGuard prev_guard, guard;
+  while (first != last) {
+    prev_guard = std::move(guard);
+    guard = bpm_->NewFrameGuarded();
+    auto leaf = guard.template AsMut<LeafFrame>();
+    leaf->Init();
+    for (; first != last && !leaf->Filled(fill_factor) && leaf->CanInsert(first->first); ++first) {
+      leaf->Append(first->first, first->second);
+    }
+    if (prev_guard.Valid()) {
+      prev_guard.template AsMut<LeafFrame>()->SetNextPageId(guard.PageId());
+    }
+    level.emplace_back(leaf->KeyAt(1), guard.PageId());
+  }
+  // the last leaf may be short: top it up from the one before, or merge the two if that one cannot spare enough
+  auto leaf = guard.template AsMut<LeafFrame>();
+  if (prev_guard.Valid() && leaf->Underflow()) {
+    auto prev = prev_guard.template AsMut<LeafFrame>();
+    if (leaf->BorrowFrom(prev, false)) {
+      level.back().first = leaf->KeyAt(1);
+    } else {
+      leaf->MoveTo(1, prev);
+      prev->SetNextPageId(INVALID_PAGE_ID);
+      guard.Delete();
+      level.pop_back();
+    }
+  }
+  prev_guard.Drop();
+  guard.Drop();
+  // sizes below count children, so that the root may be left with a single key
+  size_t internal_capacity = capacity(InternalFrame::GetMinSize(), InternalFrame::GetMaxSize()) + 1;
+  while (level.size() > 1) {
+    std::vector<std::pair<KeyType, page_id_t> > parents;
+    for (size_t pos = 0; pos < level.size();) {
+      auto count = BulkLoadChunk(level.size() - pos, internal_capacity, InternalFrame::GetMinSize() + 1);
+      auto guard = bpm_->NewFrameGuarded();
+      auto internal = guard.template AsMut<InternalFrame>();
+      internal->Init();
+      internal->SetValueAt(0, level[pos].second);
+      for (size_t i = 1; i < count; ++i) {
+        internal->SetKeyAt(i, level[pos + i].first);
+        internal->SetValueAt(i, level[pos + i].second);
+      }
+      internal->SetSize(count - 1);
+      internal->Reindex();
+      parents.emplace_back(level[pos].first, guard.PageId());
+      pos += count;
+    }
+    level = std::move(parents);
+  }
+  SetRootId(level[0].second);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::BulkLoadChunk(size_t remaining,
+                                                                         size_t capacity, size_t min_size) -> size_t {
+  if (remaining <= capacity || remaining - capacity >= min_size) {
+    return std::min(remaining, capacity);
+  }
+  // The last two frames: a full one would leave the other below its minimum size, so split them evenly.
+  // If even that is too few, take everything: it is then less than twice the minimum size, which fits in a frame.
+  return remaining >= 2 * min_size ? remaining / 2 : remaining;
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::GetOrEmplace(const KeyType &key, auto value_generator, ValueType *value) -> bool {
+  if (concurrent_) {
+    // the generator runs once, in the exclusive section, so only a hit is served under the shared latch
+    auto lock = SharedLatch();
+    if (GetValueImpl(key, value)) return false;
+  }
+  ExclusiveSection section(this);
+  return GetOrEmplaceImpl(key, value_generator, value);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::GetOrEmplaceImpl(const KeyType &key, auto value_generator, ValueType *value) -> bool {
   Context ctx = FindLeafFrame(key);
   if (ctx.stack_.empty()) {
     ctx.current_frame_ = CreateRootFrame();
@@ -87,9 +215,9 @@ auto BPlusTree<KeyType, ValueType>::GetOrEmplace(const KeyType &key, auto value_
     ctx.stack_.emplace_back(ctx.root_page_id_, 0);
   } else {
     auto leaf = ctx.current_frame_.template As<LeafFrame>();
-    if (ctx.stack_.back().Index() <= leaf->GetSize() &&
-      leaf->KeyAt(ctx.stack_.back().Index()) == key) {
-      if (value) *value = leaf->ValueAt(ctx.stack_.back().Index());
+    auto index = ctx.stack_.back().Index();
+    if (0 < index && index <= leaf->GetSize() && leaf->KeyAt(index) == key) {
+      if (value) *value = leaf->ValueAt(index);
       return false;
     }
   }
@@ -97,28 +225,106 @@ auto BPlusTree<KeyType, ValueType>::GetOrEmplace(const KeyType &key, auto value_
   InsertInLeaf(key, value_, ctx);
   return true;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::Remove(const KeyType &key) -> bool {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Remove(const KeyType &key) -> bool {
+  if (concurrent_) {
+    auto removed = UpdateLeaf(key, [&](Context &ctx, const LeafFrame *leaf, bool found) -> std::optional<bool> {
+      if (!found) return false;
+      bool rebalance = ctx.IsRootPage(ctx.current_frame_.PageId())
+                         ? leaf->GetSize() == 1
+                         : !leaf->CanRemove(ctx.stack_.back().Index());
+      if (rebalance) return std::nullopt;
+      RemoveInFrame<LeafFrame>(ctx);
+      return true;
+    });
+    if (removed) return *removed;
+  }
+  ExclusiveSection section(this);
+  return RemoveImpl(key);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveImpl(const KeyType &key) -> bool {
   auto ctx = FindLeafFrame(key);
   if (ctx.stack_.empty()) {
     return false;
   }
   auto leaf = ctx.current_frame_.template As<LeafFrame>();
-  if (ctx.stack_.back().Index() > leaf->GetSize()
-    || leaf->KeyAt(ctx.stack_.back().Index()) != key) {
+  auto index = ctx.stack_.back().Index();
+  if (index == 0 || index > leaf->GetSize() || leaf->KeyAt(index) != key) {
     return false;
   }
   RemoveInLeaf(ctx);
   return true;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::GetValue(const KeyType &key, ValueType *value) -> PositionHint {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertBatch(std::span<const std::pair<KeyType,
+                                                                       ValueType> > items) -> size_t {
+  ExclusiveSection section(this);
+  size_t inserted = 0;
+  for (size_t i = 0; i < items.size();) {
+    Context ctx = FindLeafFrame(items[i].first);
+    if (ctx.stack_.empty()) {
+      inserted += InsertImpl(items[i].first, items[i].second);
+      ++i;
+      continue;
+    }
+    do {
+      const auto &[key, value] = items[i++];
+      auto leaf = ctx.current_frame_.template As<LeafFrame>();
+      auto index = KeyIndex(key, leaf) - 1;
+      if (index > 0 && leaf->KeyAt(index) == key) continue;
+      ctx.stack_.back() = {ctx.current_frame_.PageId(), index};
+      ++inserted;
+      if (!leaf->CanInsert(key)) {
+        InsertInLeaf(key, value, ctx); // splits, the next key needs a new descent
+        break;
+      }
+      InsertInLeafPlain(key, value, ctx);
+    } while (i < items.size() && (!ctx.upper_bound_ || items[i].first < *ctx.upper_bound_));
+  }
+  return inserted;
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveBatch(std::span<const KeyType> keys) -> size_t {
+  ExclusiveSection section(this);
+  size_t removed = 0;
+  for (size_t i = 0; i < keys.size();) {
+    Context ctx = FindLeafFrame(keys[i]);
+    if (ctx.stack_.empty()) break;
+    bool changed = false;
+    do {
+      const auto &key = keys[i++];
+      auto leaf = ctx.current_frame_.template As<LeafFrame>();
+      auto index = KeyIndex(key, leaf) - 1;
+      if (index == 0 || leaf->KeyAt(index) != key) continue;
+      ctx.stack_.back() = {ctx.current_frame_.PageId(), index};
+      RemoveInFrame<LeafFrame>(ctx);
+      changed = true;
+      ++removed;
+    } while (i < keys.size() && (!ctx.upper_bound_ || keys[i] < *ctx.upper_bound_));
+    if (changed) RebalanceLeaf(ctx);
+  }
+  return removed;
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::GetValue(const KeyType &key,
+                                                                    ValueType *value) -> PositionHint {
+  auto lock = SharedLatch();
+  return GetValueImpl(key, value);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::GetValueImpl(const KeyType &key,
+                                                                        ValueType *value) -> PositionHint {
   auto current_page_id = GetRootId();
   if (current_page_id == INVALID_PAGE_ID) {
     return {};
   }
+  BasicFrameGuard next_frame_guard;
+  if (pinned_levels_ > 0) next_frame_guard = DescendSwizzled(key, &current_page_id, nullptr);
   do {
-    auto current_frame_guard = bpm_->FetchFrameBasic(current_page_id);
+    auto current_frame_guard = next_frame_guard.Valid()
+                                 ? std::move(next_frame_guard)
+                                 : bpm_->FetchFrameBasic(current_page_id);
     bool is_leaf = current_frame_guard.template As<BPlusTreeFrame>()->IsLeafFrame();
     if (!is_leaf) {
       auto current_frame = current_frame_guard.template As<InternalFrame>();
@@ -126,70 +332,226 @@ auto BPlusTree<KeyType, ValueType>::GetValue(const KeyType &key, ValueType *valu
       current_page_id = current_frame->ValueAt(index);
     } else {
       auto current_frame = current_frame_guard.template As<LeafFrame>();
-      auto index = KeyIndex(key, current_frame) - 1;
-      if (0 < index && index <= current_frame->GetSize() && current_frame->KeyAt(index) == key) {
-        if (value) *value = current_frame->ValueAt(index);
+      while (true) {
+        auto version = current_frame_guard.ReadVersion();
+        auto index = KeyIndex(key, current_frame) - 1;
+        bool found = 0 < index && index <= current_frame->GetSize() && current_frame->KeyAt(index) == key;
+        ValueType found_value = found ? current_frame->ValueAt(index) : ValueType();
+        if (!current_frame_guard.Validate(version)) continue;
+        if (!found) return {};
+        if (value) *value = found_value;
         return {current_page_id, index};
-      } else {
-        return {};
       }
     }
   } while (true);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::LowerBound(const KeyType &key) -> Iterator {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::LowerBound(const KeyType &key) -> Iterator {
+  auto lock = SharedLatch();
+  return LowerBoundImpl(key);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::LowerBoundImpl(const KeyType &key) -> Iterator {
   auto ctx = FindLeafFrame(key);
   if (ctx.stack_.empty()) {
     return {this, {}};
   }
   auto leaf = ctx.current_frame_.template As<LeafFrame>();
-  auto index = ctx.stack_.back().Index();
-  if (0 < index && index <= leaf->GetSize() && leaf->KeyAt(index) == key) {
-    return {this, ctx.stack_.back(), std::move(ctx.current_frame_)};
+  while (true) {
+    auto version = ctx.current_frame_.ReadVersion();
+    // in concurrent mode the leaf may have changed since the descent read it
+    auto index = concurrent_ ? KeyIndex(key, leaf) - 1 : ctx.stack_.back().Index();
+    if (index == 0 || leaf->KeyAt(index) != key) ++index; // the first key above
+    if (index > leaf->GetSize()) {
+      // the first key of the next leaf is above the leaf's upper bound, hence above the key
+      auto next_page_id = leaf->GetNextPageId();
+      if (!ctx.current_frame_.Validate(version)) continue;
+      if (next_page_id == INVALID_PAGE_ID) {
+        return {this, {}};
+      }
+      return {this, {next_page_id, 1}};
+    }
+    Iterator it{this, {ctx.stack_.back().PageId(), index}, {}};
+    it.key_ = leaf->KeyAt(index);
+    it.value_ = leaf->ValueAt(index);
+    if (!ctx.current_frame_.Validate(version)) continue;
+    it.version_ = version;
+    it.frame_ = std::move(ctx.current_frame_);
+    return it;
   }
-  if (index < leaf->GetSize()) {
-    return {this, {ctx.stack_.back().PageId(), index + 1}, std::move(ctx.current_frame_)};
-  } else {
-    if (leaf->GetNextPageId() == INVALID_PAGE_ID) {
-      return {this, {}};
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Iterator::Load() {
+  while (true) {
+    auto version = frame_.ReadVersion();
+    key_ = Frame()->KeyAt(hint_.Index(), &run_);
+    value_ = Frame()->ValueAt(hint_.Index());
+    if (frame_.Validate(version)) {
+      version_ = version;
+      return;
+    }
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Iterator::PrefetchAhead() {
+  ++leaves_;
+  if (ahead_ > 0) --ahead_; // the current leaf was one of them
+  int window = std::min(leaves_, BPT_PREFETCH_LEAVES);
+  if (ahead_ * 2 > window) return;
+  if (window > 1) {
+    // key_ is the first key of the leaf, so the descent ends in this leaf, at the last position of its parent
+    auto ctx = bpt_->FindLeafFrame(key_);
+    if (ctx.stack_.size() >= 2 && ctx.stack_.back().PageId() == hint_.PageId()) {
+      auto parent_hint = ctx.stack_[ctx.stack_.size() - 2];
+      auto parent_guard = bpt_->bpm_->FetchFrameBasic(parent_hint.PageId());
+      auto parent = parent_guard.template As<InternalFrame>();
+      int last = std::min(parent_hint.Index() + window, parent->GetSize());
+      for (int i = parent_hint.Index() + ahead_ + 1; i <= last; ++i) {
+        bpt_->bpm_->Prefetch(parent->ValueAt(i));
+      }
+      if (last > parent_hint.Index()) {
+        ahead_ = std::max(ahead_, last - parent_hint.Index());
+        return;
+      }
+    }
+  }
+  // the last child of its parent, or a scan that has only just started: the leaf chain gives the next leaf
+  if (ahead_ == 0) {
+    bpt_->bpm_->Prefetch(Frame()->GetNextPageId());
+    ahead_ = 1;
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Iterator::AdvanceShared() -> Iterator & {
+  auto lock = bpt_->SharedLatch();
+  while (true) {
+    auto version = frame_.ReadVersion();
+    if (version != version_) {
+      // the leaf changed since the entry was read, so look the entry up again
+      auto it = bpt_->LowerBoundImpl(key_);
+      bool same_entry = it.hint_.found() && it.key_ == key_;
+      *this = std::move(it);
+      if (!same_entry) return *this; // the entry was removed, its successor is the next one
+      continue;
+    }
+    auto leaf = Frame();
+    auto index = hint_.Index() + 1;
+    if (index <= leaf->GetSize()) {
+      KeyType key = leaf->KeyAt(index);
+      ValueType value = leaf->ValueAt(index);
+      if (!frame_.Validate(version)) continue;
+      hint_.index_ = index;
+      key_ = key;
+      value_ = value;
+      return *this;
+    }
+    auto next_page_id = leaf->GetNextPageId();
+    if (!frame_.Validate(version)) continue;
+    if (next_page_id == INVALID_PAGE_ID) {
+      hint_ = {};
+      frame_.Drop();
     } else {
-      return {this, {leaf->GetNextPageId(), 1}};
+      auto leaves = leaves_, ahead = ahead_;
+      *this = Iterator(bpt_, {next_page_id, 1}); // leaves are never empty under the shared latch
+      leaves_ = leaves;
+      ahead_ = ahead;
+      PrefetchAhead();
     }
+    return *this;
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Iterator::SetValue(const ValueType &value) -> void {
+  if (!bpt_->concurrent_) {
+    FrameMut()->SetValueAt(hint_.Index(), value);
+    value_ = value;
+    return;
   }
+  bpt_->UpdateLeaf(key_, [&](Context &ctx, const LeafFrame *, bool found) -> std::optional<bool> {
+    if (found) ctx.current_frame_.template AsMut<LeafFrame>()->SetValueAt(ctx.stack_.back().Index(), value);
+    return found;
+  });
+  value_ = value;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::GetRootId() const -> page_id_t {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::GetRootId() const -> page_id_t {
   return root_page_id_;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::Empty() const -> bool { return GetRootId() == INVALID_PAGE_ID; }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::SetRootId(page_id_t root_id) -> void {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Empty() const -> bool { return GetRootId() == INVALID_PAGE_ID; }
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SetRootId(page_id_t root_id) -> void {
+  page_id_t old_root_id = root_page_id_;
   root_page_id_ = root_id;
+  if (swizzled_root_ == nullptr || root_id == INVALID_PAGE_ID) {
+    Unswizzle();
+    return;
+  }
+  auto old_root = swizzled_root_;
+  if (old_root->frame->GetSize() == 0 && old_root->frame->ValueAt(0) == root_id) {
+    // the root collapsed into its only child, which takes over the tier one level up
+    auto child = old_root->leaf_parent ? nullptr : old_root->children[0];
+    if (child == nullptr) {
+      Unswizzle();
+      return;
+    }
+    swizzled_root_ = child;
+    RemoveSwizzled(old_root);
+    for (auto &node : swizzled_) --node->level;
+    return;
+  }
+  auto root_guard = bpm_->FetchFrameBasic(root_id);
+  if (root_guard.template As<BPlusTreeFrame>()->IsLeafFrame()
+      || root_guard.template As<InternalFrame>()->ValueAt(0) != old_root_id) {
+    Unswizzle();
+    return;
+  }
+  // a new root above the old one: the tier grows a level at the top, and its bottom level falls out of it
+  for (auto &node : swizzled_) ++node->level;
+  auto root = NewSwizzledNode(root_guard, 0);
+  if (root == nullptr) {
+    Unswizzle();
+    return;
+  }
+  swizzled_root_ = root;
+  for (size_t i = 0; i < swizzled_.size();) {
+    auto node = swizzled_[i].get();
+    if (node->level >= pinned_levels_) {
+      RemoveSwizzled(node); // moves another node to slot i
+      continue;
+    }
+    if (node->level + 1 == pinned_levels_ && !node->leaf_parent) {
+      std::fill(node->children.begin(), node->children.end(), nullptr);
+    }
+    ++i;
+  }
+  RelinkSwizzled(root);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::KeyIndex(const KeyType &key, auto *frame) -> int {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::KeyIndex(const KeyType &key, auto *frame) -> int {
   // find the first index i that key < frame->KeyAt(i), frame->GetSize() + 1 if not found
-  // TODO(opt): interpolation search
-  auto keys = frame->Keys();
-  auto it = upper_bound(keys + 1, keys + frame->GetSize() + 1, key);
-  return it - keys;
+  return frame->UpperIndex(key); // depends on the frame layout
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::FindLeafFrame(const KeyType &key) -> Context {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::FindLeafFrame(const KeyType &key) -> Context {
   Context ctx;
   ctx.root_page_id_ = GetRootId();
   if (ctx.root_page_id_ == INVALID_PAGE_ID) {
     return ctx;
   }
   page_id_t current_page_id = ctx.root_page_id_;
+  BasicFrameGuard next_frame_guard;
+  if (pinned_levels_ > 0) next_frame_guard = DescendSwizzled(key, &current_page_id, &ctx);
   do {
-    auto current_frame_guard = bpm_->FetchFrameBasic(current_page_id);
+    auto current_frame_guard = next_frame_guard.Valid()
+                                 ? std::move(next_frame_guard)
+                                 : bpm_->FetchFrameBasic(current_page_id);
     bool is_leaf = current_frame_guard.template As<BPlusTreeFrame>()->IsLeafFrame();
     if (!is_leaf) {
       auto current_frame = current_frame_guard.template As<InternalFrame>();
       auto index = KeyIndex(key, current_frame) - 1;
       ctx.stack_.emplace_back(current_page_id, index);
+      if (index < current_frame->GetSize()) ctx.upper_bound_ = current_frame->KeyAt(index + 1);
       current_page_id = current_frame->ValueAt(index);
     } else {
       auto current_frame = current_frame_guard.template As<LeafFrame>();
@@ -200,30 +562,182 @@ auto BPlusTree<KeyType, ValueType>::FindLeafFrame(const KeyType &key) -> Context
     }
   } while (true);
 }
-template<typename KeyType, typename ValueType>
-void BPlusTree<KeyType, ValueType>::MoveData(auto *array, size_t begin, size_t end, int offset) {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::DescendSwizzled(const KeyType &key, page_id_t *page_id, Context *ctx) -> BasicFrameGuard {
+  if (swizzled_root_ == nullptr) {
+    if (concurrent_) return {}; // only exclusive sections build the tier then
+    if (auto root_guard = SwizzleTier(); root_guard.Valid()) return root_guard;
+  }
+  if constexpr (!BPT_SWIZZLE) {
+    return {};
+  }
+  SwizzledNode *node = swizzled_root_;
+  while (true) {
+    auto index = KeyIndex(key, node->frame) - 1;
+    if (ctx) {
+      ctx->stack_.emplace_back(node->page_id, index);
+      if (index < node->frame->GetSize()) ctx->upper_bound_ = node->frame->KeyAt(index + 1);
+    }
+    *page_id = node->frame->ValueAt(index);
+    if (node->leaf_parent) {
+      return {};
+    }
+    if (node->children[index] != nullptr) {
+      node = node->children[index];
+      continue;
+    }
+    auto child_guard = bpm_->FetchFrameBasic(*page_id);
+    if (concurrent_) {
+      return child_guard; // the tier is read-only under the shared latch
+    }
+    if (child_guard.template As<BPlusTreeFrame>()->IsLeafFrame()) {
+      node->leaf_parent = true;
+      node->children = {};
+      return child_guard;
+    }
+    if (node->level + 1 >= pinned_levels_) {
+      return child_guard; // below the tier, the rest of the descent goes through the buffer pool
+    }
+    // left out by PinUpperLevels for lack of budget, which may have been released since
+    auto child = NewSwizzledNode(child_guard, node->level + 1);
+    if (child == nullptr) {
+      return child_guard;
+    }
+    node = node->children[index] = child;
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::NewSwizzledNode(BasicFrameGuard &guard,
+                                                                           int level) -> SwizzledNode * {
+  if (!bpm_->ReservePins(1)) {
+    return nullptr;
+  }
+  auto node = std::make_unique<SwizzledNode>();
+  node->page_id = guard.PageId();
+  node->frame = guard.template As<InternalFrame>();
+  node->level = level;
+  node->guard = std::move(guard);
+  node->children.assign(InternalFrame::GetMaxSize() + 1, nullptr);
+  node->slot = swizzled_.size();
+  swizzled_slots_.Insert(node->page_id, static_cast<PageTable::frame_id_t>(node->slot));
+  swizzled_.push_back(std::move(node));
+  return swizzled_.back().get();
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::PinUpperLevels() {
+  // swizzled_ is in breadth first order, so a short budget goes to the levels closest to the root
+  for (size_t i = 0; i < swizzled_.size(); ++i) {
+    auto node = swizzled_[i].get();
+    if (node->level + 1 >= pinned_levels_) return;
+    for (int j = 0; j <= node->frame->GetSize(); ++j) {
+      auto child_guard = bpm_->FetchFrameBasic(node->frame->ValueAt(j));
+      if (child_guard.template As<BPlusTreeFrame>()->IsLeafFrame()) {
+        node->leaf_parent = true;
+        node->children = {};
+        break;
+      }
+      node->children[j] = NewSwizzledNode(child_guard, node->level + 1);
+      if (node->children[j] == nullptr) return;
+    }
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SwizzleTier() -> BasicFrameGuard {
+  if (swizzled_root_ != nullptr || Empty()) {
+    return {};
+  }
+  auto root_guard = bpm_->FetchFrameBasic(GetRootId());
+  if (root_guard.template As<BPlusTreeFrame>()->IsLeafFrame()) {
+    return root_guard;
+  }
+  swizzled_root_ = NewSwizzledNode(root_guard, 0);
+  if (swizzled_root_ == nullptr) {
+    return root_guard;
+  }
+  PinUpperLevels();
+  return {};
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Unswizzle() {
+  for (auto &node : swizzled_) swizzled_slots_.Erase(node->page_id);
+  bpm_->ReleasePins(swizzled_.size());
+  swizzled_root_ = nullptr;
+  swizzled_.clear(); // drops the pins
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveSwizzled(SwizzledNode *node) {
+  size_t slot = node->slot;
+  swizzled_slots_.Erase(node->page_id);
+  if (slot + 1 != swizzled_.size()) {
+    std::swap(swizzled_[slot], swizzled_.back());
+    swizzled_[slot]->slot = slot;
+    swizzled_slots_.Insert(swizzled_[slot]->page_id, static_cast<PageTable::frame_id_t>(slot));
+  }
+  swizzled_.pop_back(); // drops the pin
+  bpm_->ReleasePins(1);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::DropSwizzled(SwizzledNode *node) {
+  for (auto child : node->children) {
+    if (child != nullptr) DropSwizzled(child);
+  }
+  RemoveSwizzled(node);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RelinkSwizzled(SwizzledNode *node) {
+  // the bottom level of the tier has no children in it
+  if (node->leaf_parent || node->level + 1 >= pinned_levels_) return;
+  int size = node->frame->GetSize();
+  for (int i = 0; i <= size; ++i) node->children[i] = SwizzledNodeOf(node->frame->ValueAt(i));
+  std::fill(node->children.begin() + size + 1, node->children.end(), nullptr);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::PatchSwizzled(page_id_t page_id,
+                                                                         const InternalFrame *frame, bool moved_in) {
+  if (auto node = SwizzledNodeOf(page_id); node != nullptr) {
+    RelinkSwizzled(node);
+    return;
+  }
+  if (!moved_in) return; // nothing below a frame outside the tier is in it
+  for (int i = 0; i <= frame->GetSize(); ++i) {
+    if (auto child = SwizzledNodeOf(frame->ValueAt(i)); child != nullptr) DropSwizzled(child);
+  }
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SwizzleSplit(page_id_t page_id,
+                                                                        BasicFrameGuard &new_guard) {
+  auto node = SwizzledNodeOf(page_id);
+  if (node == nullptr) return;
+  auto new_frame = new_guard.template As<InternalFrame>();
+  auto sibling = NewSwizzledNode(new_guard, node->level);
+  RelinkSwizzled(node);
+  if (sibling == nullptr) {
+    // out of budget, the children that moved leave the tier
+    PatchSwizzled(new_guard.PageId(), new_frame, true);
+    return;
+  }
+  if (node->leaf_parent) {
+    sibling->leaf_parent = true;
+    sibling->children = {};
+  }
+  RelinkSwizzled(sibling);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::MoveData(auto *array, size_t begin, size_t end, int offset) {
   char buffer[sizeof(LeafFrame)];
   size_t move_size = (end - begin) * sizeof(decltype(*array));
   std::memcpy(buffer, array + begin, move_size);
   std::memcpy(array + begin + offset, buffer, move_size);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::InsertInLeafPlain(const KeyType &key,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertInLeafPlain(const KeyType &key,
                                                       const ValueType &value,
                                                       Context &context) -> void {
   auto leaf_frame = context.current_frame_.template AsMut<LeafFrame>();
-  auto index = context.stack_.back().Index() + 1;
-  auto keys = leaf_frame->Keys();
-  auto values = leaf_frame->Values();
-  auto size = leaf_frame->GetSize();
-  MoveData(keys, index, size + 1, 1);
-  MoveData(values, index, size + 1, 1);
-  keys[index] = key;
-  values[index] = value;
-  leaf_frame->IncreaseSize(1);
+  leaf_frame->InsertAt(context.stack_.back().Index() + 1, key, value);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::InsertInInternal(const KeyType &key,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertInInternal(const KeyType &key,
                                                      page_id_t new_page_id,
                                                      Context &context) -> void {
   auto internal_frame = context.current_frame_.template AsMut<InternalFrame>();
@@ -236,9 +750,11 @@ auto BPlusTree<KeyType, ValueType>::InsertInInternal(const KeyType &key,
   keys[index] = key;
   values[index] = new_page_id;
   internal_frame->IncreaseSize(1);
+  internal_frame->Reindex();
+  PatchSwizzled(context.current_frame_.PageId(), internal_frame, false);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::InsertInParent(page_id_t old_page_id,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::InsertInParent(page_id_t old_page_id,
                                                    const KeyType &key,
                                                    page_id_t new_page_id,
                                                    Context &context) -> void {
@@ -250,6 +766,7 @@ auto BPlusTree<KeyType, ValueType>::InsertInParent(page_id_t old_page_id,
     new_root->SetKeyAt(1, key);
     new_root->SetValueAt(0, context.root_page_id_);
     new_root->SetValueAt(1, new_page_id);
+    new_root->Reindex();
     SetRootId(new_root_guard.PageId());
     return;
   }
@@ -276,9 +793,12 @@ auto BPlusTree<KeyType, ValueType>::InsertInParent(page_id_t old_page_id,
     std::memcpy(new_internal->Values(), parent_frame->Values() + split_index, (move_count + 1) * sizeof(page_id_t));
     new_internal->SetSize(move_count);
     parent_frame->SetSize(split_index - 1);
+    new_internal->Reindex();
+    parent_frame->Reindex();
     if (left) {
       if (key_to_insert < key) {
         parent_frame->IncreaseSize(1);
+        parent_frame->Reindex();
         new_internal->SetValueAt(0, new_page_id);
         key_to_insert = key;
       } else {
@@ -292,22 +812,30 @@ auto BPlusTree<KeyType, ValueType>::InsertInParent(page_id_t old_page_id,
       InsertInInternal(key, new_page_id, context);
       new_internal_guard = std::move(context.current_frame_);
     }
+    SwizzleSplit(old_page_id, new_internal_guard);
     new_internal_guard.Drop();
     InsertInParent(old_page_id, key_to_insert, new_internal_id, context);
   }
 }
-template<typename KeyType, typename ValueType>
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
 template<typename FrameType>
-auto BPlusTree<KeyType, ValueType>::RemoveInFrame(Context &context) -> void {
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveInFrame(Context &context) -> void {
   auto frame = context.current_frame_.template AsMut<FrameType>();
   auto index = context.stack_.back().Index();
-  auto size = frame->GetSize();
-  MoveData(frame->Keys(), index + 1, size + 1, -1);
-  MoveData(frame->Values(), index + 1, size + 1, -1);
-  frame->IncreaseSize(-1);
+  if constexpr (std::is_same_v<FrameType, LeafFrame>) {
+    frame->RemoveAt(index);
+  } else {
+    auto size = frame->GetSize();
+    MoveData(frame->Keys(), index + 1, size + 1, -1);
+    MoveData(frame->Values(), index + 1, size + 1, -1);
+    frame->IncreaseSize(-1);
+    frame->Reindex();
+    PatchSwizzled(context.current_frame_.PageId(), frame, false);
+  }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::FindSibling(Context &context, const InternalFrame *parent_frame) {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::FindSibling(Context &context,
+                                                                       const InternalFrame *parent_frame) {
   auto index = context.stack_[context.stack_.size() - 2].Index();
   if (index == 0) {
     return std::make_pair(parent_frame->ValueAt(1), true);
@@ -315,9 +843,13 @@ auto BPlusTree<KeyType, ValueType>::FindSibling(Context &context, const Internal
     return std::make_pair(parent_frame->ValueAt(index - 1), false);
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::RemoveInLeaf(Context &context) -> void {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveInLeaf(Context &context) -> void {
   RemoveInFrame<LeafFrame>(context);
+  RebalanceLeaf(context);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RebalanceLeaf(Context &context) -> void {
   auto leaf = context.current_frame_.template AsMut<LeafFrame>();
   if (context.IsRootPage(context.current_frame_.PageId())) {
     if (leaf->GetSize() == 0) {
@@ -326,7 +858,7 @@ auto BPlusTree<KeyType, ValueType>::RemoveInLeaf(Context &context) -> void {
     }
     return;
   }
-  if (leaf->GetSize() >= LeafFrame::GetMinSize()) {
+  if (!leaf->Underflow()) {
     return;
   }
   auto parent_frame_guard = bpm_->FetchFrameBasic(
@@ -336,35 +868,14 @@ auto BPlusTree<KeyType, ValueType>::RemoveInLeaf(Context &context) -> void {
   auto parent_index = context.stack_[context.stack_.size() - 2].Index() + sibling_is_right;
   auto sibling_frame_guard = bpm_->FetchFrameBasic(sibling_page_id);
   auto sibling_frame = sibling_frame_guard.template AsMut<LeafFrame>();
-  if (sibling_frame->GetSize() > LeafFrame::GetMinSize()) {
-    // borrow
-    if (sibling_is_right) {
-      auto key = sibling_frame->KeyAt(1);
-      auto value = sibling_frame->ValueAt(1);
-      leaf->SetKeyAt(leaf->GetSize() + 1, key);
-      leaf->SetValueAt(leaf->GetSize() + 1, value);
-      leaf->IncreaseSize(1);
-      // switch context to sibling
-      context.current_frame_ = std::move(sibling_frame_guard);
-      context.stack_.back() = {sibling_page_id, 1};
-      RemoveInFrame<LeafFrame>(context);
-      parent_frame->SetKeyAt(parent_index, sibling_frame->KeyAt(1));
-    } else {
-      auto key = sibling_frame->KeyAt(sibling_frame->GetSize());
-      auto value = sibling_frame->ValueAt(sibling_frame->GetSize());
-      sibling_frame->IncreaseSize(-1);
-      context.stack_.back() = {context.stack_.back().PageId(), 0};
-      InsertInLeafPlain(key, value, context);
-      parent_frame->SetKeyAt(parent_index, key);
-    }
+  if (leaf->BorrowFrom(sibling_frame, sibling_is_right)) {
+    parent_frame->SetKeyAt(parent_index, sibling_is_right ? sibling_frame->KeyAt(1) : leaf->KeyAt(1));
+    parent_frame->Reindex();
   } else {
     // merge
     auto left = sibling_is_right ? leaf : sibling_frame;
     auto right = sibling_is_right ? sibling_frame : leaf;
-    auto move_count = right->GetSize();
-    std::memcpy(left->Keys() + left->GetSize() + 1, right->Keys() + 1, move_count * sizeof(KeyType));
-    std::memcpy(left->Values() + left->GetSize() + 1, right->Values() + 1, move_count * sizeof(ValueType));
-    left->IncreaseSize(move_count);
+    right->MoveTo(1, left);
     left->SetNextPageId(right->GetNextPageId());
     if (sibling_is_right) {
       sibling_frame_guard.Delete();
@@ -383,8 +894,8 @@ auto BPlusTree<KeyType, ValueType>::RemoveInLeaf(Context &context) -> void {
     RemoveInInternal(context);
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::RemoveInInternal(Context &context) -> void {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveInInternal(Context &context) -> void {
   RemoveInFrame<InternalFrame>(context);
   auto internal = context.current_frame_.template AsMut<InternalFrame>();
   if (context.IsRootPage(context.current_frame_.PageId())) {
@@ -428,6 +939,11 @@ auto BPlusTree<KeyType, ValueType>::RemoveInInternal(Context &context) -> void {
       sibling_frame->IncreaseSize(-1);
       parent_frame->SetKeyAt(parent_index, key);
     }
+    internal->Reindex();
+    sibling_frame->Reindex();
+    parent_frame->Reindex();
+    PatchSwizzled(context.current_frame_.PageId(), internal, SwizzledNodeOf(sibling_page_id) != nullptr);
+    PatchSwizzled(sibling_page_id, sibling_frame, false);
   } else {
     // merge
     auto left = sibling_is_right ? internal : sibling_frame;
@@ -437,6 +953,11 @@ auto BPlusTree<KeyType, ValueType>::RemoveInInternal(Context &context) -> void {
     std::memcpy(left->Keys() + left->GetSize() + 2, right->Keys() + 1, move_count * sizeof(KeyType));
     std::memcpy(left->Values() + left->GetSize() + 1, right->Values(), (move_count + 1) * sizeof(page_id_t));
     left->IncreaseSize(move_count + 1);
+    left->Reindex();
+    // the children of the right frame go along with it into the left one
+    auto right_node = SwizzledNodeOf(sibling_is_right ? sibling_page_id : context.current_frame_.PageId());
+    if (right_node != nullptr) RemoveSwizzled(right_node);
+    PatchSwizzled(sibling_is_right ? context.current_frame_.PageId() : sibling_page_id, left, right_node != nullptr);
     if (sibling_is_right) {
       sibling_frame_guard.Delete();
       context.current_frame_.Drop();
@@ -454,11 +975,11 @@ auto BPlusTree<KeyType, ValueType>::RemoveInInternal(Context &context) -> void {
     RemoveInInternal(context);
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::SetValue(const KeyType &key,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SetValue(const KeyType &key,
                                              const ValueType &value,
                                              const PositionHint &hint) -> bool {
-  if (!hint.found()) return SetValue(key, value);
+  if (concurrent_ || !hint.found()) return SetValue(key, value);
   auto guard = bpm_->FetchFrameBasic(hint.PageId());
   auto leaf = guard.template AsMut<LeafFrame>();
   if (leaf->IsLeafFrame() && hint.Index() < leaf->GetSize() && leaf->KeyAt(hint.Index()) == key) {
@@ -467,19 +988,38 @@ auto BPlusTree<KeyType, ValueType>::SetValue(const KeyType &key,
   }
   return SetValue(key, value);
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::SetValue(const KeyType &key, const ValueType &value) -> bool {
-  if (Insert(key, value)) {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SetValue(const KeyType &key,
+                                                                    const ValueType &value) -> bool {
+  if (concurrent_) {
+    auto inserted = UpdateLeaf(key, [&](Context &ctx, const LeafFrame *leaf, bool found) -> std::optional<bool> {
+      if (found) {
+        ctx.current_frame_.template AsMut<LeafFrame>()->SetValueAt(ctx.stack_.back().Index(), value);
+        return false;
+      }
+      if (!leaf->CanInsert(key)) return std::nullopt;
+      InsertInLeafPlain(key, value, ctx);
+      return true;
+    });
+    if (inserted) return *inserted;
+  }
+  ExclusiveSection section(this);
+  return SetValueImpl(key, value);
+}
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::SetValueImpl(const KeyType &key,
+                                                                        const ValueType &value) -> bool {
+  if (InsertImpl(key, value)) {
     return true;
   }
-  auto hint = GetValue(key);
+  auto hint = GetValueImpl(key, nullptr);
   auto guard = bpm_->FetchFrameBasic(hint.PageId());
   auto leaf = guard.template AsMut<LeafFrame>();
   leaf->SetValueAt(hint.Index(), value);
   return false;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::PartialSearch(const auto &key) -> std::vector<std::pair<KeyType, ValueType> > {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::PartialSearch(const auto &key) -> std::vector<std::pair<KeyType, ValueType> > {
   using KeyTypeFirst = KeyType::first_type;
   using KeyTypeSecond = KeyType::second_type;
   static_assert(std::is_same_v<decltype(key), const KeyTypeFirst &>);
@@ -491,18 +1031,18 @@ auto BPlusTree<KeyType, ValueType>::PartialSearch(const auto &key) -> std::vecto
   }
   return result;
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::RemoveAll(const auto &key) -> void {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::RemoveAll(const auto &key) -> void {
   auto toDelete = PartialSearch(key);
   for (auto &pair : toDelete) {
     Remove(pair.first);
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::ValidateBPlusTree(page_id_t root_page_id,
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::ValidateBPlusTree(page_id_t root_page_id,
                                                       page_id_t page_id,
-                                                      const KeyType &lower_bound,
-                                                      const KeyType &upper_bound) -> int {
+                                                      const std::optional<KeyType> &lower_bound,
+                                                      const std::optional<KeyType> &upper_bound) -> int {
   if (page_id < 0) {
     throw std::runtime_error("Invalid page id");
   }
@@ -515,14 +1055,14 @@ auto BPlusTree<KeyType, ValueType>::ValidateBPlusTree(page_id_t root_page_id,
         throw std::runtime_error("Root page size is 0");
       }
     } else {
-      if (leaf->GetSize() < LeafFrame::GetMinSize()) {
+      if (leaf->Underflow()) {
         throw std::runtime_error("Leaf frame size too small");
       }
     }
     if (leaf->GetSize() > LeafFrame::GetMaxSize()) {
       throw std::runtime_error("Leaf frame size too large");
     }
-    if (leaf->KeyAt(1) < lower_bound || leaf->KeyAt(leaf->GetSize()) >= upper_bound) {
+    if ((lower_bound && leaf->KeyAt(1) < *lower_bound) || (upper_bound && leaf->KeyAt(leaf->GetSize()) >= *upper_bound)) {
       throw std::runtime_error("Leaf frame key out of range");
     }
     for (int i = 1; i <= leaf->GetSize(); i++) {
@@ -545,7 +1085,11 @@ auto BPlusTree<KeyType, ValueType>::ValidateBPlusTree(page_id_t root_page_id,
     if (internal->GetSize() > InternalFrame::GetMaxSize()) {
       throw std::runtime_error("Internal frame size too large");
     }
-    if (internal->KeyAt(1) < lower_bound || internal->KeyAt(internal->GetSize()) >= upper_bound) {
+    if (!internal->FencesValid()) {
+      throw std::runtime_error("Internal frame fences out of date");
+    }
+    if ((lower_bound && internal->KeyAt(1) < *lower_bound)
+      || (upper_bound && internal->KeyAt(internal->GetSize()) >= *upper_bound)) {
       throw std::runtime_error("Internal frame key out of range");
     }
     int depth = 0;
@@ -566,29 +1110,31 @@ auto BPlusTree<KeyType, ValueType>::ValidateBPlusTree(page_id_t root_page_id,
     return depth + 1;
   }
 }
-template<typename KeyType, typename ValueType>
-auto BPlusTree<KeyType, ValueType>::Validate() -> bool {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+auto BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Validate() -> bool {
+  ExclusiveSection section(this);
   auto root_page_id = GetRootId();
   if (root_page_id == INVALID_PAGE_ID) {
     return true;
   }
   try {
-    ValidateBPlusTree(root_page_id, root_page_id, KeyType(), std::numeric_limits<KeyType>::max());
+    ValidateBPlusTree(root_page_id, root_page_id, std::nullopt, std::nullopt); // composite keys have no max()
   } catch (std::runtime_error &e) {
     std::cerr << "Error: " << e.what() << "\n";
     return false;
   }
   return true;
 }
-template<typename KeyType, typename ValueType>
-void BPlusTree<KeyType, ValueType>::Print() {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::Print() {
+  ExclusiveSection section(this);
   auto root_page_id = GetRootId();
   if (root_page_id == INVALID_PAGE_ID) return;
   auto guard = bpm_->FetchFrameBasic(root_page_id);
   PrintTree(guard.PageId(), guard.template As<BPlusTreeFrame>());
 }
-template<typename KeyType, typename ValueType>
-void BPlusTree<KeyType, ValueType>::PrintTree(page_id_t page_id, const BPlusTreeFrame *page) {
+template<typename KeyType, typename ValueType, InternalLayout Layout, int PagesPerFrame>
+void BPlusTree<KeyType, ValueType, Layout, PagesPerFrame>::PrintTree(page_id_t page_id, const BPlusTreeFrame *page) {
   if (page_id < 1) return;
   if (page->IsLeafFrame()) {
     auto *leaf = reinterpret_cast<const LeafFrame *>(page);
@@ -7,30 +7,95 @@
 #pragma ide diagnostic ignored "Simplify"
 #include "buffer_pool_manager.h"
 #include "b_plus_tree_frame.h"
+#include "key_search.h"
 #include "lru_k_replacer.h"
 #include "utility.h"
 #include "stlite/vector.h"
 
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
 namespace storage {
-template<typename KeyType, typename ValueType>
+/**
+ * @brief B+ tree stored in frames of the buffer pool.
+ *
+ * Frames are `PagesPerFrame` pages, the frame size of the buffer pool: trees that are mostly scanned use larger
+ * frames than trees of point lookups, see `BPT_SCAN_PAGES_PER_FRAME`.
+ *
+ * The top `pinned_levels` levels of the tree form a tier that stays pinned in the buffer pool, mirrored by
+ * `SwizzledNode`s: each one keeps its frame pinned and points straight to the nodes of its internal children. With
+ * `BPT_SWIZZLE` a descent follows these pointers and only goes through the buffer pool below the tier; without it,
+ * the tier just keeps its frames resident. The tier is built breadth first by the first descent,
+ * and patched in place when the child array of an internal frame in it changes: the new frame of an internal split
+ * gets a node of its own, merges and borrows take the nodes of the moved children along, and a new or collapsed root
+ * adds or removes a level. Children whose new parent is not in the tier leave it, along with the nodes below them.
+ * Leaves are never swizzled.
+ * All trees of a buffer pool share its `BPM_PIN_BUDGET`: once it is spent, deeper levels are fetched as usual.
+ *
+ * In concurrent mode (on a concurrent buffer pool) several threads may use the tree at once. Structure
+ * modifications hold `latch_` exclusively; everything else holds it shared, so internal frames and the tier are
+ * read-only then. Inserts, removes and updates that fit in their leaf change it in place under its write latch,
+ * and fall back to an exclusive section otherwise. Leaves are read optimistically: the leaf version is checked
+ * after the read, and the read is retried if it changed. An iterator holds no latch between steps; it caches its
+ * entry, and looks the entry up again when it finds its leaf changed.
+ */
+template<typename KeyType, typename ValueType, InternalLayout Layout = BPT_INTERNAL_LAYOUT,
+         int PagesPerFrame = BPT_PAGES_PER_FRAME>
 class BPlusTree {
  public:
-  static constexpr int PagesPerFrame = BPT_PAGES_PER_FRAME;
-  using InternalFrame = BPlusTreeInternalFrame<KeyType, page_id_t, PagesPerFrame>;
-  using LeafFrame = BPlusTreeLeafFrame<KeyType, ValueType, PagesPerFrame>;
+  using InternalFrame = BPlusTreeInternalFrame<KeyType, page_id_t, PagesPerFrame, Layout>;
+  using LeafFrame = std::conditional_t<BPT_PACKED_LEAVES && IsPackedPair<KeyType>::value,
+                                      BPlusTreePackedLeafFrame<KeyType, ValueType, PagesPerFrame>,
+                                      BPlusTreeLeafFrame<KeyType, ValueType, PagesPerFrame> >;
   using BasicFrameGuard = BufferPoolManager<PagesPerFrame>::BasicFrameGuard;
   class PositionHint;
   class Iterator;
 
-  explicit BPlusTree(BufferPoolManager<PagesPerFrame> *bpm, page_id_t &root_page_id, bool reset = false);
+  explicit BPlusTree(BufferPoolManager<PagesPerFrame> *bpm,
+                     page_id_t &root_page_id,
+                     bool reset = false,
+                     int pinned_levels = BPT_PINNED_LEVELS,
+                     bool concurrent = BPT_CONCURRENT);
+
+  ~BPlusTree() { Unswizzle(); }
 
   auto Insert(const KeyType &key, const ValueType &value) -> bool;
 
+  /**
+   * @brief Build the tree bottom-up from `[first, last)`, whose elements have the key in `first` and the value in
+   * `second`, and whose keys are strictly increasing. The tree must be empty.
+   *
+   * Leaves are filled to `fill_factor` of their capacity and written one after another through the buffer pool,
+   * then each internal level is built from the first keys of the level below. Frames are never filled below
+   * their minimum size, so the result passes `Validate`; only the last two frames of a level may differ in size.
+   */
+  template<std::forward_iterator It>
+  void BulkLoad(It first, It last, double fill_factor = BPT_BULK_LOAD_FILL);
+
   /// @brief store to *value if found, call value_generator otherwise
   auto GetOrEmplace(const KeyType &key, auto value_generator, ValueType *value = nullptr) -> bool;
 
   auto Remove(const KeyType &key) -> bool;
 
+  /**
+   * @brief Insert `items`, sorted by strictly increasing key; keys already present are skipped.
+   * Keys that land in the leaf of the previous one are inserted without a new descent, until the leaf splits.
+   * @return The number of keys inserted
+   */
+  auto InsertBatch(std::span<const std::pair<KeyType, ValueType> > items) -> size_t;
+
+  /**
+   * @brief Remove `keys`, sorted in strictly increasing order; missing keys are skipped.
+   * All keys of a leaf are removed after a single descent, and the leaf is rebalanced once they are gone.
+   * @return The number of keys removed
+   */
+  auto RemoveBatch(std::span<const KeyType> keys) -> size_t;
+
   auto GetValue(const KeyType &key, ValueType *value = nullptr) -> PositionHint;
 
   auto LowerBound(const KeyType &key) -> Iterator;
@@ -71,13 +136,15 @@ class BPlusTree {
     friend class BPlusTree;
    public:
     Iterator() = default;
-    Iterator(const BPlusTree *bpt, const PositionHint &hint) : bpt_(bpt), hint_(hint) {
+    Iterator(BPlusTree *bpt, const PositionHint &hint) : bpt_(bpt), hint_(hint) {
       if (hint.found()) {
         frame_ = bpt_->bpm_->FetchFrameBasic(hint_.PageId());
+        Load();
       }
     }
 
     auto operator++() -> Iterator & {
+      if (bpt_->concurrent_) return AdvanceShared();
       ++hint_.index_;
       if (hint_.index_ > Frame()->GetSize()) {
         if (Frame()->GetNextPageId() == INVALID_PAGE_ID) {
@@ -86,26 +153,44 @@ class BPlusTree {
         } else {
           hint_ = {Frame()->GetNextPageId(), 1};
           frame_ = bpt_->bpm_->FetchFrameBasic(Frame()->GetNextPageId());
+          Load();
+          PrefetchAhead();
+          return *this;
         }
       }
+      if (hint_.found()) Load();
       return *this;
     }
-    auto operator*() -> std::pair<KeyType, ValueType> {
-      return {Frame()->Key(hint_.Index()), Frame()->Value(hint_.Index())};
-    }
-    auto SetValue(const ValueType &value) -> void { FrameMut()->SetValue(hint_.Index(), value); }
-    auto Key() const -> KeyType { return Frame()->KeyAt(hint_.Index()); }
-    auto Value() const -> ValueType { return Frame()->ValueAt(hint_.Index()); }
+    auto operator*() -> std::pair<KeyType, ValueType> { return {Key(), Value()}; }
+    auto SetValue(const ValueType &value) -> void;
+    auto Key() const -> KeyType { return key_; }
+    auto Value() const -> ValueType { return value_; }
 
     auto operator==(const Iterator &other) const -> bool { return bpt_ == other.bpt_ && hint_ == other.hint_; }
     auto operator!=(const Iterator &other) const -> bool { return !(*this == other); }
    private:
-    const BPlusTree *bpt_{};
+    BPlusTree *bpt_{};
     PositionHint hint_{};
     BasicFrameGuard frame_{};
-    Iterator(const BPlusTree *bpt, const PositionHint &hint, BasicFrameGuard frame) : bpt_(bpt), hint_(hint), frame_(std::move(frame)) {}
-    auto Frame() const -> const LeafFrame * { return frame_.As<LeafFrame>(); }
-    auto FrameMut() -> LeafFrame * { return frame_.AsMut<LeafFrame>(); }
+    // the entry, read once per step as packed leaves decode their keys; as of `version_` of its leaf
+    KeyType key_{};
+    ValueType value_{};
+    uint64_t version_{};
+    int run_{-1}; // run of the entry in a packed leaf, where the next `Load` looks first
+    // a scan that has crossed n leaf boundaries is likely to cross n more, so up to n leaves ahead are prefetched
+    int leaves_{}; // leaf boundaries crossed
+    int ahead_{}; // leaves after the current one that are prefetched
+    Iterator(BPlusTree *bpt, const PositionHint &hint, BasicFrameGuard frame) : bpt_(bpt), hint_(hint), frame_(std::move(frame)) {}
+    auto Frame() const -> const LeafFrame * { return frame_.template As<LeafFrame>(); }
+    auto FrameMut() -> LeafFrame * { return frame_.template AsMut<LeafFrame>(); }
+    void Load(); // read the entry at `hint_` into the cache
+    /**
+     * @brief Called on entering a leaf: keep the next `min(leaves_, BPT_PREFETCH_LEAVES)` leaves prefetched.
+     * The leaf chain only tells the next leaf, so their page ids are read from the parent, found by a descent
+     * to the first key of the leaf; that descent is repeated once half of the prefetched leaves are used up.
+     */
+    void PrefetchAhead();
+    auto AdvanceShared() -> Iterator &; // operator++ in concurrent mode
   };
 
   auto End() -> Iterator { return Iterator(this, {}); }
@@ -117,19 +202,99 @@ class BPlusTree {
  private:
   BufferPoolManager<PagesPerFrame> *bpm_;
   page_id_t &root_page_id_;
+  const bool concurrent_;
+  std::shared_mutex latch_; // exclusive for structure modifications, shared otherwise; only taken in concurrent mode
+  std::mutex writer_gate_; // held while waiting for `latch_` exclusively, so that readers cannot starve the writer
+
+  /// @brief Holds `latch_` exclusively in concurrent mode, and rebuilds the tier before releasing it
+  class ExclusiveSection {
+   public:
+    explicit ExclusiveSection(BPlusTree *bpt) : bpt_(bpt) {
+      if (!bpt_->concurrent_) return;
+      std::lock_guard gate(bpt_->writer_gate_);
+      bpt_->latch_.lock();
+    }
+    ~ExclusiveSection() {
+      if (!bpt_->concurrent_) return;
+      if (bpt_->pinned_levels_ > 0) bpt_->SwizzleTier();
+      bpt_->latch_.unlock();
+    }
+    ExclusiveSection(const ExclusiveSection &) = delete;
+    auto operator=(const ExclusiveSection &) -> ExclusiveSection & = delete;
+   private:
+    BPlusTree *bpt_;
+  };
+  auto SharedLatch() -> std::shared_lock<std::shared_mutex>; // locks `latch_` in concurrent mode
+
+  struct SwizzledNode {
+    BasicFrameGuard guard; // the pin that keeps the frame resident
+    page_id_t page_id;
+    const InternalFrame *frame;
+    int level; // 0 for the root
+    bool leaf_parent = false; // known once a descent has reached a leaf child, whose nodes are never swizzled
+    std::vector<SwizzledNode *> children; // by child index, nullptr until swizzled
+    size_t slot; // in `swizzled_`
+  };
+  const int pinned_levels_; // 0 if the tree does not swizzle
+  SwizzledNode *swizzled_root_{nullptr};
+  std::vector<std::unique_ptr<SwizzledNode> > swizzled_;
+  PageTable swizzled_slots_; // page id of a node to its slot in `swizzled_`
 
   class Context {
    public:
     page_id_t root_page_id_{INVALID_PAGE_ID};
     sjtu::vector<PositionHint> stack_;
     BasicFrameGuard current_frame_{};
+    std::optional<KeyType> upper_bound_{}; // keys of the leaf are below it, set by the descents
     auto IsRootPage(page_id_t page_id) const -> bool { return page_id == root_page_id_; }
   };
 
   auto CreateRootFrame() -> BasicFrameGuard;
+  // the operations without latching, for callers that hold `latch_` as needed
+  auto InsertImpl(const KeyType &key, const ValueType &value) -> bool;
+  auto GetOrEmplaceImpl(const KeyType &key, auto value_generator, ValueType *value) -> bool;
+  auto RemoveImpl(const KeyType &key) -> bool;
+  auto GetValueImpl(const KeyType &key, ValueType *value) -> PositionHint;
+  auto LowerBoundImpl(const KeyType &key) -> Iterator;
+  auto SetValueImpl(const KeyType &key, const ValueType &value) -> bool;
+  /**
+   * @brief Concurrent mode: call `update(ctx, leaf, found)` on the leaf of `key` under its write latch and the
+   * shared `latch_`. `ctx.stack_.back()` is the position of the last key not above `key`, at which it is `found`.
+   * @return What `update` returns: nullopt if the change does not fit in the leaf, or if the tree is empty
+   */
+  auto UpdateLeaf(const KeyType &key, auto update) -> std::optional<bool>;
+  /// @brief Number of children the next frame of a bulk loaded internal level takes out of the `remaining` ones
+  static auto BulkLoadChunk(size_t remaining, size_t capacity, size_t min_size) -> size_t;
   auto SetRootId(page_id_t root_id) -> void;
   auto KeyIndex(const KeyType &key, auto *frame) -> int;
   auto FindLeafFrame(const KeyType &key) -> Context;
+  /**
+   * @brief Descend the swizzled levels from the root towards the key, pushing the internal positions to `ctx`.
+   * Without `BPT_SWIZZLE` it only builds the tier, and the descent starts from the root.
+   * @param page_id In: the root. Out: the first page below the swizzled levels.
+   * @return The frame of `*page_id` if it had to be fetched on the way, an empty guard otherwise
+   */
+  auto DescendSwizzled(const KeyType &key, page_id_t *page_id, Context *ctx) -> BasicFrameGuard;
+  /// @brief Takes over `guard`, unless the budget of the buffer pool is spent; nullptr then
+  auto NewSwizzledNode(BasicFrameGuard &guard, int level) -> SwizzledNode *;
+  void PinUpperLevels(); // fill the tier breadth first, starting from the swizzled root
+  /// @brief Build the tier if it is missing; returns the root frame if it could not be swizzled
+  auto SwizzleTier() -> BasicFrameGuard;
+  void Unswizzle(); // drop the whole tier
+  /// @return The node of the frame if it is in the tier, nullptr otherwise
+  auto SwizzledNodeOf(page_id_t page_id) const -> SwizzledNode * {
+    if (swizzled_.empty()) return nullptr;
+    auto slot = swizzled_slots_.Find(page_id);
+    return slot == PageTable::kNotFound ? nullptr : swizzled_[slot].get();
+  }
+  void RemoveSwizzled(SwizzledNode *node); // the node alone, its children stay in the tier
+  void DropSwizzled(SwizzledNode *node); // the node and the nodes below it
+  /// @brief Point the children of the node at the nodes of its frame's children, after its child array changed
+  void RelinkSwizzled(SwizzledNode *node);
+  /// @brief Mirror the change of the child array of `frame` in the tier; `moved_in` if children came from a sibling
+  void PatchSwizzled(page_id_t page_id, const InternalFrame *frame, bool moved_in);
+  /// @brief Give the new frame of an internal split a node next to the node of the frame split, if it has one
+  void SwizzleSplit(page_id_t page_id, BasicFrameGuard &new_guard);
   static void MoveData(auto *array, size_t begin, size_t end, int offset); // [begin, end)
   void InsertInLeaf(const KeyType &key, const ValueType &value, Context &ctx);
   auto InsertInLeafPlain(const KeyType &key, const ValueType &value, Context &context) -> void;
@@ -143,12 +308,13 @@ class BPlusTree {
   // \return pair<page_id_t, bool> page_id_t is the page_id of the sibling, bool is true if the sibling is right sibling
   auto FindSibling(Context &context, const InternalFrame *parent_frame);
   auto RemoveInLeaf(Context &context) -> void;
+  auto RebalanceLeaf(Context &context) -> void; // borrow from or merge with a sibling if below the minimum size
   auto RemoveInInternal(Context &context) -> void;
 
   auto ValidateBPlusTree(page_id_t root_page_id,
                          page_id_t page_id,
-                         const KeyType &lower_bound,
-                         const KeyType &upper_bound) -> int; // return depth of the tree, throw std::runtime_error if invalid
+                         const std::optional<KeyType> &lower_bound,
+                         const std::optional<KeyType> &upper_bound) -> int; // return depth of the tree, throw std::runtime_error if invalid
 
   void PrintTree(page_id_t page_id, const BPlusTreeFrame *page);
 };
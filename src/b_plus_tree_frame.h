@@ -4,8 +4,10 @@
 
 #pragma once
 #include <algorithm>
+#include <array>
 #include <execution>
 #include "buffer_pool_manager.h"
+#include "key_search.h"
 
 namespace storage {
 
@@ -58,8 +60,15 @@ static_assert(sizeof(BPlusTreeFrame) == 4, "BPlusTreeFrame size is not correct")
  * ----------------------------------------------------------------------------------------
  * | HEADER | KEY(1) | KEY(2) | ... | KEY(n) | PAGE_ID(0) | PAGE_ID(1) | ... | PAGE_ID(n) |
  * ----------------------------------------------------------------------------------------
+ *
+ * The BLOCKED layout makes the frame a two-level B-tree: the keys are cut into blocks of a cache line, and the first
+ * key of every block is repeated in a fence array after the page ids. A search ranks the key among the fences, then
+ * within one block, instead of a binary search over all keys that touches a cache line per step. The header is padded
+ * to a cache line and the fences start on one, so that each block and the fences take whole cache lines of a frame
+ * whose data is aligned to `CACHE_LINE_SIZE`, as the buffer pool keeps it.
+ * The fences must be rebuilt with `Reindex` after the keys change, see `FencesValid`.
  */
-template<typename KeyType, typename ValueType, int PagePerFrame = 1>
+template<typename KeyType, typename ValueType, int PagePerFrame = 1, InternalLayout Layout = BPT_INTERNAL_LAYOUT>
 class BPlusTreeInternalFrame : public BPlusTreeFrame {
  public:
   // Delete all constructor / destructor to ensure memory safety
@@ -105,28 +114,97 @@ class BPlusTreeInternalFrame : public BPlusTreeFrame {
   auto ValueAt(int index) const -> ValueType { return values_[index]; }
   void SetValueAt(int index, const ValueType &value) { values_[index] = value; }
 
+  /// @return The first index i that key < KeyAt(i), GetSize() + 1 if there is none
+  auto UpperIndex(const KeyType &key) const -> int;
+  void Reindex(); // rebuild the fences from the keys, a no-op for the SORTED layout
+  auto FencesValid() const -> bool;
+
   static constexpr int GetMaxSize() {
-    return std::min(
-        (Frame<PagePerFrame>::kFrameSize - kHeaderSize - sizeof(page_id_t)) / (sizeof(KeyType) + sizeof(page_id_t)),
-        static_cast<size_t>(BPT_MAX_DEGREE)
-    );
+    size_t max_size;
+    if constexpr (kBlocked) {
+      // the most keys whose page ids, padding and fences still fit behind them; the last block may be partial
+      size_t space = Frame<PagePerFrame>::kDataSize - CACHE_LINE_SIZE;
+      max_size = space / (sizeof(KeyType) + sizeof(ValueType));
+      while (max_size > 0 && FencesEnd(max_size) > Frame<PagePerFrame>::kDataSize) --max_size;
+    } else {
+      size_t space = Frame<PagePerFrame>::kDataSize - kHeaderSize - sizeof(page_id_t);
+      max_size = space / (sizeof(KeyType) + sizeof(page_id_t));
+    }
+    return std::min(max_size, static_cast<size_t>(BPT_MAX_DEGREE));
   }
   static constexpr int GetMinSize() { return kMaxSize / 2; }
  private:
+  static constexpr bool kBlocked = Layout == InternalLayout::BLOCKED;
+  static constexpr int kBlockSize = std::max<int>(1, CACHE_LINE_SIZE / sizeof(KeyType)); // keys per cache line
   static constexpr int kHeaderSize = sizeof(BPlusTreeFrame);
+  /// @brief Offset of the fences of a BLOCKED frame of `max_size` keys, the first cache line after the page ids
+  static constexpr size_t FencesBegin(size_t max_size) {
+    size_t values_end = CACHE_LINE_SIZE + max_size * sizeof(KeyType) + (max_size + 1) * sizeof(ValueType);
+    return (values_end + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  }
+  static constexpr size_t FencesEnd(size_t max_size) {
+    return FencesBegin(max_size) + (max_size + kBlockSize - 1) / kBlockSize * sizeof(KeyType);
+  }
   static constexpr int kMaxSize = GetMaxSize(); // the maximal index of keys in this frame
-
+  static constexpr int kMaxFences = kBlocked ? (kMaxSize + kBlockSize - 1) / kBlockSize : 0;
+  static constexpr size_t kKeysPadding = kBlocked ? CACHE_LINE_SIZE - kHeaderSize : 0;
+  static constexpr size_t kFencesPadding =
+    kBlocked ? FencesBegin(kMaxSize) - CACHE_LINE_SIZE - kMaxSize * sizeof(KeyType) - (kMaxSize + 1) * sizeof(ValueType)
+             : 0;
+  struct NoFences {};
+  struct NoPadding {};
+  template<size_t Size>
+  using Padding = std::conditional_t<Size != 0, std::array<char, Size>, NoPadding>;
+
+  [[no_unique_address]] Padding<kKeysPadding> keys_padding_;
   KeyType keys_[kMaxSize];
   ValueType values_[kMaxSize + 1];
+  [[no_unique_address]] Padding<kFencesPadding> fences_padding_;
+  [[no_unique_address]] std::conditional_t<kBlocked, std::array<KeyType, kMaxFences>, NoFences> fences_;
 
+  auto FenceCount() const -> int { return (GetSize() + kBlockSize - 1) / kBlockSize; }
 };
-template<typename KeyType, typename ValueType, int PagePerFrame>
-void BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame>::Init() {
+template<typename KeyType, typename ValueType, int PagePerFrame, InternalLayout Layout>
+void BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame, Layout>::Init() {
   SetSize(0);
   SetFrameType(IndexFrameType::INTERNAL_FRAME);
 }
-template<typename KeyType, typename ValueType, int PagePerFrame>
-auto BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame>::ValueIndex(const ValueType &value) const -> int {
+template<typename KeyType, typename ValueType, int PagePerFrame, InternalLayout Layout>
+auto BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame, Layout>::UpperIndex(const KeyType &key) const -> int {
+  if constexpr (!kBlocked) {
+    return 1 + KeyRank(keys_, GetSize(), key);
+  } else {
+    // the fences at or below the key, the last of which starts the block that holds the rank
+    int fences = KeyRank(fences_.data(), FenceCount(), key);
+    if (fences == 0) return 1;
+    int begin = (fences - 1) * kBlockSize;
+    int block_size = std::min(kBlockSize, GetSize() - begin);
+    if constexpr (OrderedKey<KeyType>::kSupported) {
+      return 1 + begin + key_search::CountNotAbove(keys_ + begin, block_size, key);
+    } else {
+      return 1 + begin + key_search::RankBinary(keys_ + begin, block_size, key);
+    }
+  }
+}
+template<typename KeyType, typename ValueType, int PagePerFrame, InternalLayout Layout>
+void BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame, Layout>::Reindex() {
+  if constexpr (kBlocked) {
+    for (int i = 0, fences = FenceCount(); i < fences; ++i) {
+      fences_[i] = keys_[i * kBlockSize];
+    }
+  }
+}
+template<typename KeyType, typename ValueType, int PagePerFrame, InternalLayout Layout>
+auto BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame, Layout>::FencesValid() const -> bool {
+  if constexpr (kBlocked) {
+    for (int i = 0, fences = FenceCount(); i < fences; ++i) {
+      if (fences_[i] != keys_[i * kBlockSize]) return false;
+    }
+  }
+  return true;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame, InternalLayout Layout>
+auto BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame, Layout>::ValueIndex(const ValueType &value) const -> int {
   // use std::find and std::execution::par_unseq
   auto it = std::find(std::execution::par_unseq,
                       values_, values_ + GetSize() + 1, value);
@@ -141,10 +219,16 @@ auto BPlusTreeInternalFrame<KeyType, ValueType, PagePerFrame>::ValueIndex(const
  * | HEADER | KEY(1) | ... | KEY(n) | VALUE(1) | ... | VALUE(n) |
  * --------------------------------------------------------------
  *
+ * A tree of an empty value type such as `NoValue` is a set: its leaves have no VALUE array at all.
+ *
  * Header format (size in bit, 8 bytes in total):
  * -----------------------------------------------------
  * | PageType (1) | CurrentSize (31) | NextPageId (32) |
  * -----------------------------------------------------
+ *
+ * The tree changes a leaf only through `InsertAt`, `RemoveAt`, `MoveTo` and `BorrowFrom`, and asks the leaf whether
+ * it is full or below its minimum (`CanInsert`, `CanRemove`, `Underflow`), so that `BPlusTreePackedLeafFrame`, whose
+ * capacity depends on its keys, can stand in for it.
  */
 template<typename KeyType, typename ValueType, int PagePerFrame = 1>
 class BPlusTreeLeafFrame : public BPlusTreeFrame {
@@ -168,13 +252,13 @@ class BPlusTreeLeafFrame : public BPlusTreeFrame {
    */
   auto Keys() -> KeyType * { return keys_ - 1; }
   auto Keys() const -> const KeyType * { return keys_ - 1; }
-  auto Values() -> ValueType * { return values_ - 1; }
-  auto Values() const -> const ValueType * { return values_ - 1; }
   /**
   * @param index The index of the key to get. Index must be non-zero.
   * @return Key at index
   */
   auto KeyAt(int index) const -> KeyType { return keys_[index - 1]; }
+  /// @brief `KeyAt` for scans, see BPlusTreePackedLeafFrame; there are no runs to keep track of here
+  auto KeyAt(int index, int *) const -> KeyType { return keys_[index - 1]; }
 
   /**
   * @param index The index of the key to set. Index must be non-zero.
@@ -186,12 +270,39 @@ class BPlusTreeLeafFrame : public BPlusTreeFrame {
   * @param index The index to search for
   * @return The value at the index
   */
-  auto ValueAt(int index) const -> ValueType { return values_[index - 1]; }
-  void SetValueAt(int index, const ValueType &value) { values_[index - 1] = value; }
+  auto ValueAt(int index) const -> ValueType {
+    if constexpr (kKeyOnly) {
+      return {};
+    } else {
+      return values_[index - 1];
+    }
+  }
+  void SetValueAt(int index, const ValueType &value) {
+    if constexpr (!kKeyOnly) values_[index - 1] = value;
+  }
+
+  /// @return The first index i that key < KeyAt(i), GetSize() + 1 if there is none
+  auto UpperIndex(const KeyType &key) const -> int { return 1 + KeyRank(keys_, GetSize(), key); }
+  auto CanInsert(const KeyType &) const -> bool { return GetSize() < kMaxSize; }
+  void InsertAt(int index, const KeyType &key, const ValueType &value); // the entry becomes the index-th one
+  void Append(const KeyType &key, const ValueType &value) { InsertAt(GetSize() + 1, key, value); }
+  auto CanRemove(int) const -> bool { return GetSize() > GetMinSize(); } // false if RemoveAt would underflow
+  void RemoveAt(int index);
+  auto Underflow() const -> bool { return GetSize() < GetMinSize(); }
+  auto Filled(double fill_factor) const -> bool { // full enough for a bulk load
+    return GetSize() >= std::clamp(static_cast<int>(fill_factor * kMaxSize), GetMinSize(), kMaxSize);
+  }
+  auto SplitIndex() const -> int { return (GetSize() + 1) / 2; } // the number of entries a full frame keeps
+  void MoveTo(int begin, BPlusTreeLeafFrame *dst); // append the entries from `begin` on to `dst`
+  /**
+   * @brief Bring an underflowing frame up to its minimum with the nearest entries of its sibling.
+   * @return false, with nothing moved, if the sibling would underflow; the two then fit in one frame
+   */
+  auto BorrowFrom(BPlusTreeLeafFrame *sibling, bool sibling_is_right) -> bool;
 
   static constexpr int GetMaxSize() {
     return std::min(
-        (Frame<PagePerFrame>::kFrameSize - kHeaderSize) / (sizeof(KeyType) + sizeof(ValueType)),
+        (Frame<PagePerFrame>::kDataSize - kHeaderSize) / (sizeof(KeyType) + kValueSize),
         static_cast<size_t>(BPT_MAX_DEGREE)
     );
   }
@@ -199,11 +310,14 @@ class BPlusTreeLeafFrame : public BPlusTreeFrame {
 
  private:
   static constexpr int kHeaderSize = sizeof(BPlusTreeFrame) + sizeof(page_id_t);
+  static constexpr bool kKeyOnly = std::is_empty_v<ValueType>; // a set of keys, e.g. of `NoValue`: no value array
+  static constexpr size_t kValueSize = kKeyOnly ? 0 : sizeof(ValueType);
   static constexpr int kMaxSize = GetMaxSize(); // the maximal index of keys in this frame
+  struct NoValues {};
 
   page_id_t next_page_id_ = INVALID_PAGE_ID;
   KeyType keys_[kMaxSize];
-  ValueType values_[kMaxSize];
+  [[no_unique_address]] std::conditional_t<kKeyOnly, NoValues, ValueType[kMaxSize]> values_;
 };
 
 template<typename KeyType, typename ValueType, int PagePerFrame>
@@ -212,6 +326,342 @@ void BPlusTreeLeafFrame<KeyType, ValueType, PagePerFrame>::Init() {
   SetFrameType(IndexFrameType::LEAF_FRAME);
   next_page_id_ = INVALID_PAGE_ID;
 }
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreeLeafFrame<KeyType, ValueType, PagePerFrame>::InsertAt(int index, const KeyType &key, const ValueType &value) {
+  auto move_count = GetSize() - index + 1;
+  std::memmove(keys_ + index, keys_ + index - 1, move_count * sizeof(KeyType));
+  keys_[index - 1] = key;
+  if constexpr (!kKeyOnly) {
+    std::memmove(values_ + index, values_ + index - 1, move_count * sizeof(ValueType));
+    values_[index - 1] = value;
+  }
+  IncreaseSize(1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreeLeafFrame<KeyType, ValueType, PagePerFrame>::RemoveAt(int index) {
+  auto move_count = GetSize() - index;
+  std::memmove(keys_ + index - 1, keys_ + index, move_count * sizeof(KeyType));
+  if constexpr (!kKeyOnly) std::memmove(values_ + index - 1, values_ + index, move_count * sizeof(ValueType));
+  IncreaseSize(-1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreeLeafFrame<KeyType, ValueType, PagePerFrame>::MoveTo(int begin, BPlusTreeLeafFrame *dst) {
+  auto move_count = GetSize() - begin + 1;
+  std::memcpy(dst->keys_ + dst->GetSize(), keys_ + begin - 1, move_count * sizeof(KeyType));
+  if constexpr (!kKeyOnly) {
+    std::memcpy(dst->values_ + dst->GetSize(), values_ + begin - 1, move_count * sizeof(ValueType));
+  }
+  dst->IncreaseSize(move_count);
+  SetSize(begin - 1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreeLeafFrame<KeyType, ValueType, PagePerFrame>::BorrowFrom(BPlusTreeLeafFrame *sibling,
+                                                                      bool sibling_is_right) -> bool {
+  // a batch removal may leave the frame more than one entry short
+  auto borrow_count = GetMinSize() - GetSize();
+  auto sibling_size = sibling->GetSize();
+  if (sibling_size - borrow_count < GetMinSize()) return false;
+  auto size = GetSize();
+  if (sibling_is_right) {
+    std::memcpy(keys_ + size, sibling->keys_, borrow_count * sizeof(KeyType));
+    std::memmove(sibling->keys_, sibling->keys_ + borrow_count, (sibling_size - borrow_count) * sizeof(KeyType));
+    if constexpr (!kKeyOnly) {
+      std::memcpy(values_ + size, sibling->values_, borrow_count * sizeof(ValueType));
+      std::memmove(sibling->values_, sibling->values_ + borrow_count,
+                   (sibling_size - borrow_count) * sizeof(ValueType));
+    }
+  } else {
+    std::memmove(keys_ + borrow_count, keys_, size * sizeof(KeyType));
+    std::memcpy(keys_, sibling->keys_ + sibling_size - borrow_count, borrow_count * sizeof(KeyType));
+    if constexpr (!kKeyOnly) {
+      std::memmove(values_ + borrow_count, values_, size * sizeof(ValueType));
+      std::memcpy(values_, sibling->values_ + sibling_size - borrow_count, borrow_count * sizeof(ValueType));
+    }
+  }
+  IncreaseSize(borrow_count);
+  sibling->IncreaseSize(-borrow_count);
+  return true;
+}
+
+/**
+ * Leaf frame for composite keys `PackedPair<First, Second>`. Sorted keys come in runs of equal `first` (the trains
+ * of a station, the orders of a user), so every run stores its `first` once and an entry only keeps its `second`
+ * and value. Entries grow from the front and runs from the back, so that neither moves when the other grows:
+ * -------------------------------------------------------------------------------------------------
+ * | HEADER | RunCount (16) | ENTRY(1) | ... | ENTRY(n) |  free  | RUN(m) | ... | RUN(2) | RUN(1) |
+ * -------------------------------------------------------------------------------------------------
+ * ENTRY(i) = (second, value), RUN(j) = (first, index of its first entry). A search finds the run by binary search
+ * over the runs, then the entry by binary search over the seconds of that run.
+ *
+ * The capacity is counted in bytes, so it depends on the keys. Each frame stays at least `kMinBytes` full, which
+ * is low enough that an even split of a full frame leaves both halves above it, and that two frames fit in one
+ * whenever `BorrowFrom` fails.
+ */
+template<typename KeyType, typename ValueType, int PagePerFrame = 1>
+class BPlusTreePackedLeafFrame : public BPlusTreeFrame {
+  using FirstType = typename KeyType::first_type;
+  using SecondType = typename KeyType::second_type;
+ public:
+  // Delete all constructor / destructor to ensure memory safety
+  BPlusTreePackedLeafFrame() = delete;
+  BPlusTreePackedLeafFrame(const BPlusTreePackedLeafFrame &other) = delete;
+
+  void Init();
+
+  auto GetNextPageId() const -> page_id_t { return next_page_id_; }
+  void SetNextPageId(page_id_t next_page_id) { next_page_id_ = next_page_id; }
+
+  auto KeyAt(int index) const -> KeyType { // run 0 for a torn optimistic read, which is validated afterwards
+    return {RunFirst(std::max(RunOf(index - 1), 0)), SecondAt(index - 1)};
+  }
+  /**
+   * @brief `KeyAt` for scans: `*run` is the run of the entry read before, and is set to the run of this one.
+   * Stepping within a run, or on to the next one, then needs no search of the runs.
+   */
+  auto KeyAt(int index, int *run) const -> KeyType {
+    int i = index - 1, j = *run;
+    if (j < 0 || j >= run_count_ || RunBegin(j) > i) {
+      j = RunOf(i);
+    } else if (j + 1 < run_count_ && RunBegin(j + 1) <= i) {
+      j = j + 2 < run_count_ && RunBegin(j + 2) <= i ? RunOf(i) : j + 1;
+    }
+    *run = std::max(j, 0); // as in `KeyAt`
+    return {RunFirst(*run), SecondAt(i)};
+  }
+  auto ValueAt(int index) const -> ValueType { return EntryAt(index - 1)->value; }
+  void SetValueAt(int index, const ValueType &value) { EntryAt(index - 1)->value = value; }
+
+  /// @see BPlusTreeLeafFrame, the tree uses both through the same methods
+  auto UpperIndex(const KeyType &key) const -> int;
+  auto CanInsert(const KeyType &key) const -> bool;
+  void InsertAt(int index, const KeyType &key, const ValueType &value);
+  void Append(const KeyType &key, const ValueType &value);
+  auto CanRemove(int index) const -> bool;
+  void RemoveAt(int index);
+  auto Underflow() const -> bool { return Used() < kMinBytes; }
+  auto Filled(double fill_factor) const -> bool {
+    return Used() >= std::clamp(static_cast<int>(fill_factor * kCapacity), kMinBytes, kCapacity);
+  }
+  auto SplitIndex() const -> int; // the shortest prefix that holds half of the bytes
+  void MoveTo(int begin, BPlusTreePackedLeafFrame *dst);
+  auto BorrowFrom(BPlusTreePackedLeafFrame *sibling, bool sibling_is_right) -> bool;
+
+  static constexpr int GetMaxSize() { return kCapacity / sizeof(Entry); } // all entries in a single run
+
+ private:
+  struct Run {
+    FirstType first;
+    uint16_t begin;
+  };
+  struct Entry {
+    SecondType second;
+    [[no_unique_address]] ValueType value; // takes no space in a set of keys, e.g. of `NoValue`
+  };
+  static constexpr int kHeaderSize = sizeof(BPlusTreeFrame) + sizeof(page_id_t) + sizeof(uint16_t);
+  static constexpr int kDataSize = Frame<PagePerFrame>::kDataSize - kHeaderSize;
+  static constexpr int kMaxEntryBytes = sizeof(Entry) + sizeof(Run); // an entry with a run of its own
+  // BPT_MAX_DEGREE counts entries with a run of their own here
+  static constexpr int kCapacity = BPT_MAX_DEGREE < kDataSize / kMaxEntryBytes
+                                     ? BPT_MAX_DEGREE * kMaxEntryBytes
+                                     : kDataSize;
+  static constexpr int kMinBytes = std::max(1, kCapacity / 2 - 3 * kMaxEntryBytes);
+  static_assert(kCapacity >= 4 * kMaxEntryBytes, "a packed leaf must hold at least four entries");
+
+  page_id_t next_page_id_ = INVALID_PAGE_ID;
+  uint16_t run_count_;
+  char data_[kDataSize];
+
+  auto EntryAt(int i) -> Entry * { return reinterpret_cast<Entry *>(data_) + i; } // 0-based, as the runs
+  auto EntryAt(int i) const -> const Entry * { return reinterpret_cast<const Entry *>(data_) + i; }
+  auto RunAt(int j) -> Run * { return reinterpret_cast<Run *>(data_ + kDataSize) - 1 - j; }
+  auto RunAt(int j) const -> const Run * { return reinterpret_cast<const Run *>(data_ + kDataSize) - 1 - j; }
+  auto SecondAt(int i) const -> SecondType { return EntryAt(i)->second; }
+  auto RunFirst(int j) const -> FirstType { return RunAt(j)->first; }
+  auto RunBegin(int j) const -> int { return RunAt(j)->begin; }
+  auto RunEnd(int j) const -> int { return j + 1 < run_count_ ? RunBegin(j + 1) : GetSize(); }
+  auto Used() const -> int { return GetSize() * sizeof(Entry) + run_count_ * sizeof(Run); }
+  auto RunOf(int i) const -> int; // the run of entry i
+  auto FindRun(FirstType first) const -> int; // the last run whose first is not above `first`, -1 if none
+  auto RangeBytes(int begin, int end) const -> int; // bytes the entries [begin, end) take in a frame of their own
+  void AppendRange(const BPlusTreePackedLeafFrame *src, int begin, int end); // entries [begin, end) of `src`
+  void Truncate(int size);
+};
+
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::Init() {
+  SetSize(0);
+  SetFrameType(IndexFrameType::LEAF_FRAME);
+  next_page_id_ = INVALID_PAGE_ID;
+  run_count_ = 0;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::RunOf(int i) const -> int {
+  int begin = 0;
+  for (int count = run_count_; count > 0;) {
+    int half = count / 2;
+    if (RunBegin(begin + half) <= i) {
+      begin += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return begin - 1;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::FindRun(FirstType first) const -> int {
+  int begin = 0;
+  for (int count = run_count_; count > 0;) {
+    int half = count / 2;
+    if (!(first < RunFirst(begin + half))) {
+      begin += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return begin - 1;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::UpperIndex(const KeyType &key) const -> int {
+  int run = FindRun(key.first);
+  if (run < 0) return 1;
+  int end = RunEnd(run);
+  if (RunFirst(run) < key.first) return end + 1;
+  int begin = RunBegin(run);
+  for (int count = end - begin; count > 0;) {
+    int half = count / 2;
+    if (!(key.second < SecondAt(begin + half))) {
+      begin += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return begin + 1;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::CanInsert(const KeyType &key) const -> bool {
+  int run = FindRun(key.first);
+  bool new_run = run < 0 || RunFirst(run) != key.first;
+  return Used() + static_cast<int>(sizeof(Entry)) + (new_run ? static_cast<int>(sizeof(Run)) : 0) <= kCapacity;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::InsertAt(int index,
+                                                                         const KeyType &key,
+                                                                         const ValueType &value) {
+  int i = index - 1;
+  std::memmove(EntryAt(i + 1), EntryAt(i), (GetSize() - i) * sizeof(Entry));
+  *EntryAt(i) = {key.second, value};
+  int run = FindRun(key.first);
+  if (run < 0 || RunFirst(run) != key.first) {
+    // the entry starts a run of its own after `run`, which ends right before it
+    ++run;
+    std::memmove(RunAt(run_count_), RunAt(run_count_ - 1), (run_count_ - run) * sizeof(Run));
+    *RunAt(run) = {key.first, static_cast<uint16_t>(i)};
+    ++run_count_;
+  }
+  for (int j = run + 1; j < run_count_; ++j) ++RunAt(j)->begin;
+  IncreaseSize(1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::Append(const KeyType &key, const ValueType &value) {
+  *EntryAt(GetSize()) = {key.second, value};
+  if (run_count_ == 0 || RunFirst(run_count_ - 1) != key.first) {
+    *RunAt(run_count_) = {key.first, static_cast<uint16_t>(GetSize())};
+    ++run_count_;
+  }
+  IncreaseSize(1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::CanRemove(int index) const -> bool {
+  int run = RunOf(index - 1);
+  bool last_of_run = RunEnd(run) - RunBegin(run) == 1;
+  return Used() - static_cast<int>(sizeof(Entry)) - (last_of_run ? static_cast<int>(sizeof(Run)) : 0) >= kMinBytes;
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::RemoveAt(int index) {
+  int i = index - 1;
+  int run = RunOf(i);
+  if (RunEnd(run) - RunBegin(run) == 1) {
+    std::memmove(RunAt(run_count_ - 2), RunAt(run_count_ - 1), (run_count_ - 1 - run) * sizeof(Run));
+    --run_count_;
+    --run; // the runs from `run` on follow the entry now
+  }
+  for (int j = run + 1; j < run_count_; ++j) --RunAt(j)->begin;
+  std::memmove(EntryAt(i), EntryAt(i + 1), (GetSize() - index) * sizeof(Entry));
+  IncreaseSize(-1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::RangeBytes(int begin, int end) const -> int {
+  if (begin >= end) return 0;
+  return (end - begin) * sizeof(Entry) + (RunOf(end - 1) - RunOf(begin) + 1) * sizeof(Run);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::SplitIndex() const -> int {
+  int half = Used() / 2;
+  int size = 0;
+  for (int bytes = 0; size < GetSize() - 1 && bytes < half; ++size) {
+    bytes += sizeof(Entry) + (RunOf(size) != (size == 0 ? -1 : RunOf(size - 1)) ? sizeof(Run) : 0);
+  }
+  return std::max(size, 1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::AppendRange(const BPlusTreePackedLeafFrame *src,
+                                                                            int begin,
+                                                                            int end) {
+  if (begin >= end) return;
+  for (int i = begin, run = src->RunOf(begin); i < end; ++i) {
+    while (run + 1 < src->run_count_ && src->RunBegin(run + 1) <= i) ++run;
+    Append({src->RunFirst(run), src->SecondAt(i)}, src->EntryAt(i)->value);
+  }
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::Truncate(int size) {
+  run_count_ = size == 0 ? 0 : RunOf(size - 1) + 1;
+  SetSize(size);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+void BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::MoveTo(int begin, BPlusTreePackedLeafFrame *dst) {
+  dst->AppendRange(this, begin - 1, GetSize());
+  Truncate(begin - 1);
+}
+template<typename KeyType, typename ValueType, int PagePerFrame>
+auto BPlusTreePackedLeafFrame<KeyType, ValueType, PagePerFrame>::BorrowFrom(BPlusTreePackedLeafFrame *sibling,
+                                                                            bool sibling_is_right) -> bool {
+  // take the fewest entries that lift this frame to its minimum, if the sibling stays above its own
+  int size = GetSize();
+  int sibling_size = sibling->GetSize();
+  bool shared_run = size > 0 && (sibling_is_right
+                                   ? RunFirst(run_count_ - 1) == sibling->RunFirst(0)
+                                   : sibling->RunFirst(sibling->run_count_ - 1) == RunFirst(0));
+  int count = 1;
+  for (;; ++count) {
+    if (count >= sibling_size) return false;
+    int moved = sibling_is_right ? sibling->RangeBytes(0, count)
+                                 : sibling->RangeBytes(sibling_size - count, sibling_size);
+    if (Used() + moved - (shared_run ? static_cast<int>(sizeof(Run)) : 0) >= kMinBytes) break;
+  }
+  int rest = sibling_is_right ? sibling->RangeBytes(count, sibling_size)
+                              : sibling->RangeBytes(0, sibling_size - count);
+  if (rest < kMinBytes) return false;
+  // rebuild the frame that loses its front from a copy of it
+  alignas(BPlusTreePackedLeafFrame) char buffer[sizeof(BPlusTreePackedLeafFrame)];
+  auto target = sibling_is_right ? sibling : this;
+  std::memcpy(buffer, target, sizeof(BPlusTreePackedLeafFrame));
+  auto copy = reinterpret_cast<const BPlusTreePackedLeafFrame *>(buffer);
+  if (sibling_is_right) {
+    AppendRange(copy, 0, count);
+    sibling->Truncate(0);
+    sibling->AppendRange(copy, count, sibling_size);
+  } else {
+    Truncate(0);
+    AppendRange(sibling, sibling_size - count, sibling_size);
+    AppendRange(copy, 0, size);
+    sibling->Truncate(sibling_size - count);
+  }
+  return true;
+}
 
 /**
  * The header frame is just used to retrieve the root frame,
@@ -229,12 +679,12 @@ class BPlusTreeHeaderFrame {
 // instantiate template class
 template
 class BPlusTreeInternalFrame<hash_t, page_id_t, 4>;
-static_assert(sizeof(BPlusTreeInternalFrame<hash_t, page_id_t, 4>) <= Frame<4>::kFrameSize,
+static_assert(sizeof(BPlusTreeInternalFrame<hash_t, page_id_t, 4>) <= Frame<4>::kDataSize,
               "BPlusTreeInternalFrame size is not correct");
 
 template
 class BPlusTreeLeafFrame<hash_t, int, 4>;
-static_assert(sizeof(BPlusTreeLeafFrame<hash_t, int, 4>) <= Frame<4>::kFrameSize,
+static_assert(sizeof(BPlusTreeLeafFrame<hash_t, int, 4>) <= Frame<4>::kDataSize,
               "BPlusTreeLeafFrame size is not correct");
 
 #pragma pack(pop)
@@ -4,27 +4,67 @@
 
 #pragma once
 
-#include <lru_k_replacer.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "config.h"
 #include "disk_manager.h"
+#include "page_table.h"
+#include "replacer.h"
 
 namespace storage {
 /**
- * @brief Currently, no caching is implemented.
+ * @brief Caches frames of the db file, evicting with LRU-K.
+ *
+ * In COPY mode every frame owns a buffer that pages are read into and written back from.
+ * In ZERO_COPY mode (requires the MMAP disk backend) a frame points straight into the mapping,
+ * so fetching and evicting never copy; dirty frames are synced with msync on flush. With `PAGE_CHECKSUM_ENABLED`,
+ * a frame is checked when it is loaded, and its trailer is set when it is evicted or flushed dirty.
+ *
+ * When the disk manager has asynchronous I/O (COPY mode only), the pool keeps `BPM_CLEAN_RESERVE` free frames ready:
+ * dirty victims are written back in the background and only join the free list once the write completes.
+ * A victim fetched again before that is simply kept. `Prefetch` reads a page into a free frame in the background.
+ *
+ * With the page cleaner (COPY mode only), a background thread wakes up every `BPM_CLEANER_INTERVAL_MS`, writes the
+ * dirty frames among the `BPM_CLEANER_SCAN` coldest evictable ones, and tops the free list up to `BPM_CLEAN_RESERVE`
+ * with the frames it cleaned. Every pool operation then holds `latch_`; without the cleaner the latch is never taken.
+ * The cleaner writes a snapshot of the frame, so the frame can be fetched and modified while its write is in flight.
+ *
+ * In concurrent mode every pool operation holds `latch_` as well, so that several threads can share the pool.
+ * Frame contents are not protected by the pool: each frame has a version word for optimistic latching, see
+ * `BasicFrameGuard::ReadVersion`. A page deleted while other guards still pin it is taken out of the page table at
+ * once, but its frame is only freed by the last unpin.
  * @tparam PagesPerFrame
+ * @tparam Replacer the replacement policy, see replacer.h; `BUFFER_POOL_REPLACER` by default
  */
-template<int PagesPerFrame>
+template<int PagesPerFrame, class Replacer = DefaultReplacer>
 class BufferPoolManager;
 
+/// @brief The asynchronous request a frame buffer is busy with
+enum class FrameIO : uint8_t {
+  NONE = 0,
+  READ = 1, // being prefetched
+  WRITE = 2, // being written, the frame stays resident
+  WRITE_BACK = 3, // being written, the frame is freed once the write completes
+  CLEAN = 4, // a snapshot is being written by the page cleaner, the frame can still be used
+};
+
 template<int PagesPerFrame>
 class Frame {
-  friend class BufferPoolManager<PagesPerFrame>;
+  template<int, class>
+  friend class BufferPoolManager;
 
   public:
     static constexpr int kFrameSize = PAGE_SIZE * PagesPerFrame;
+    // bytes that the content of a frame may use, the checksum trailer takes the rest
+    static constexpr int kDataSize = kFrameSize - (PAGE_CHECKSUM_ENABLED ? sizeof(uint32_t) : 0);
     auto GetData() -> char * { return data_; }
     auto GetPageId() const -> page_id_t { return page_id_; }
     auto GetPinCount() const -> int { return pin_count_; }
@@ -32,30 +72,72 @@ class Frame {
 
   private:
     page_id_t page_id_ = INVALID_PAGE_ID;
-    bool is_dirty_ = false;
+    std::atomic<bool> is_dirty_ = false;
     int pin_count_ = 0;
-    char data_[kFrameSize]{};
+    FrameIO io_ = FrameIO::NONE;
+    bool orphan_ = false; // the page was deleted while pinned, the last unpin frees the frame
+    std::atomic<uint64_t> version_ = 0; // odd while write-latched, grows with every change; never reset
+    char *data_ = nullptr; // owned by the pool in COPY mode, points into the mapping in ZERO_COPY mode
 
     void Reset() {
       page_id_ = INVALID_PAGE_ID;
       is_dirty_ = false;
       pin_count_ = 0;
-      memset(data_, 0, sizeof(data_));
+      io_ = FrameIO::NONE;
+      orphan_ = false;
     }
+    void Bump() { version_.store(version_.load(std::memory_order_relaxed) + 2, std::memory_order_release); }
 };
 
-template<int PagesPerFrame>
+/// @brief Hit and miss counts of `FetchFrameBasic`
+struct BufferPoolStats {
+  size_t hits = 0;
+  size_t misses = 0;
+};
+
+template<int PagesPerFrame, class Replacer>
 class BufferPoolManager {
   public:
     explicit BufferPoolManager(const std::string &file_path,
                                bool reset,
-                               size_t pool_size = BUFFER_POOL_SIZE) : pool_size_(pool_size),
-                                                                      disk_(file_path, reset),
-                                                                      replacer_(pool_size),
-                                                                      buffer_(pool_size), free_list_(pool_size) {
+                               size_t pool_size = BUFFER_POOL_SIZE,
+                               BufferPoolMode mode = BUFFER_POOL_MODE,
+                               bool cleaner = BPM_CLEANER_ENABLED,
+                               bool concurrent = BPM_CONCURRENT) : pool_size_(pool_size),
+                                                                         mode_(mode),
+                                                                         concurrent_(concurrent),
+                                                                         disk_(file_path, reset),
+                                                                         replacer_(pool_size),
+                                                                         page_table_(pool_size),
+                                                                         buffer_(pool_size), free_list_(pool_size),
+                                                                         pin_budget_(PinBudget()) {
       std::iota(free_list_.begin(), free_list_.end(), 0);
+      async_ = mode_ == BufferPoolMode::COPY && disk_.AsyncEnabled();
+      if (mode_ == BufferPoolMode::ZERO_COPY) {
+        if (disk_.GetBackend() != DiskBackend::MMAP) {
+          throw std::runtime_error("ZERO_COPY buffer pool requires the MMAP disk backend");
+        }
+        return;
+      }
+      // a cache line more, so that every frame can start on one, as the BLOCKED internal layout assumes
+      size_t frames_size = pool_size_ * Frame<PagesPerFrame>::kFrameSize, arena_size = frames_size + CACHE_LINE_SIZE;
+      arena_ = std::make_unique<char[]>(arena_size);
+      void *frames = arena_.get();
+      std::align(CACHE_LINE_SIZE, frames_size, frames, arena_size);
+      for (size_t i = 0; i < pool_size_; ++i) {
+        buffer_[i].data_ = static_cast<char *>(frames) + i * Frame<PagesPerFrame>::kFrameSize;
+      }
+      if (cleaner) {
+        cleaner_ = std::thread(&BufferPoolManager::CleanerLoop, this);
+      }
+    }
+    ~BufferPoolManager() {
+      StopCleaner();
+      FlushAllFrames();
+#ifdef LOCAL
+      std::cerr << "Buffer pool: " << stats_.hits << " hits, " << stats_.misses << " misses" << std::endl;
+#endif
     }
-    ~BufferPoolManager() { FlushAllFrames(); }
 
     class BasicFrameGuard {
       friend BufferPoolManager;
@@ -64,7 +146,7 @@ class BufferPoolManager {
         BasicFrameGuard() = default;
         BasicFrameGuard(const BasicFrameGuard &that) : bpm_(that.bpm_), frame_(that.frame_) {
           if (frame_ != nullptr) {
-            ++frame_->pin_count_;
+            bpm_->PinFrame(frame_);
           }
         }
         BasicFrameGuard(BasicFrameGuard &&that) noexcept: bpm_(that.bpm_), frame_(that.frame_) {
@@ -79,7 +161,7 @@ class BufferPoolManager {
           bpm_ = that.bpm_;
           frame_ = that.frame_;
           if (frame_ != nullptr) {
-            ++frame_->pin_count_;
+            bpm_->PinFrame(frame_);
           }
           return *this;
         }
@@ -98,12 +180,14 @@ class BufferPoolManager {
           Drop();
         }
 
+        auto Valid() const -> bool { return frame_ != nullptr; }
         auto PageId() -> page_id_t { return frame_->GetPageId(); }
         auto PageId() const -> page_id_t { return frame_->GetPageId(); }
         auto GetData() -> char * { return frame_->GetData(); }
         auto GetData() const -> const char * { return frame_->GetData(); }
         auto GetDataMut() -> char * {
-          frame_->is_dirty_ = true;
+          frame_->is_dirty_.store(true, std::memory_order_relaxed);
+          frame_->Bump(); // the caller is the only writer: it holds the write latch, or nobody reads optimistically
           return frame_->GetData();
         }
         template<class T>
@@ -116,15 +200,44 @@ class BufferPoolManager {
         }
         void Drop() {
           if (frame_ == nullptr) return;
-          bpm_->UnpinFrame(PageId(), frame_->is_dirty_);
+          bpm_->UnpinFrame(frame_);
           frame_ = nullptr;
         }
         void Delete() {
           if (frame_ == nullptr) return;
-          bpm_->DeletePage(PageId());
+          bpm_->DeletePage(frame_);
           frame_ = nullptr;
         }
 
+        /**
+         * @brief Start an optimistic read: wait until the frame is not write-latched, and return its version.
+         * Whatever is read afterwards is only consistent if `Validate` then succeeds with that version.
+         */
+        auto ReadVersion() const -> uint64_t {
+          uint64_t version;
+          while ((version = frame_->version_.load(std::memory_order_acquire)) & 1) {
+            std::this_thread::yield();
+          }
+          return version;
+        }
+        /// @brief Whether the frame has not changed since `ReadVersion` returned `version`
+        auto Validate(uint64_t version) const -> bool {
+          std::atomic_thread_fence(std::memory_order_acquire);
+          return frame_->version_.load(std::memory_order_relaxed) == version;
+        }
+        /// @brief Exclude other writers and make optimistic readers wait, until `WriteUnlock`
+        void WriteLock() {
+          uint64_t version = frame_->version_.load(std::memory_order_relaxed);
+          while ((version & 1) || !frame_->version_.compare_exchange_weak(version, version + 1,
+                                                                           std::memory_order_acquire)) {
+            if (version & 1) {
+              std::this_thread::yield();
+              version = frame_->version_.load(std::memory_order_relaxed);
+            }
+          }
+        }
+        void WriteUnlock() { frame_->version_.fetch_add(1, std::memory_order_release); }
+
       private:
         BasicFrameGuard(BufferPoolManager *bpm, Frame<PagesPerFrame> *frame) : bpm_(bpm), frame_(frame) {
         }
@@ -133,27 +246,97 @@ class BufferPoolManager {
     };
     auto NewFrameGuarded(page_id_t *page_id = nullptr) -> BasicFrameGuard;
     auto FetchFrameBasic(page_id_t page_id) -> BasicFrameGuard;
+    /// @brief Start reading the page in the background, so that a later fetch does not block on it
+    void Prefetch(page_id_t page_id);
     int &GetInfo(int n) { return disk_.GetInfo(n); }
     int &AllocateInfo() { return disk_.GetInfo(++info_count_); }
+    /**
+     * @brief Reserve room for `count` pins held indefinitely, such as the upper levels of B+ trees.
+     * All holders share `BPM_PIN_BUDGET` of the pool, so that they cannot starve the other frames.
+     * Trees on other threads may reserve and release at the same time, hence the atomic budget.
+     */
+    auto ReservePins(size_t count) -> bool {
+      size_t budget = pin_budget_.load(std::memory_order_relaxed);
+      do {
+        if (count > budget) return false;
+      } while (!pin_budget_.compare_exchange_weak(budget, budget - count, std::memory_order_relaxed));
+      return true;
+    }
+    void ReleasePins(size_t count) { pin_budget_.fetch_add(count, std::memory_order_relaxed); }
+    /// @brief The whole budget of `ReservePins`, reserved or not
+    auto PinBudget() const -> size_t { return static_cast<size_t>(pool_size_ * BPM_PIN_BUDGET); }
+    auto GetStats() const -> const BufferPoolStats & { return stats_; }
+    auto Concurrent() const -> bool { return concurrent_; }
+    /**
+     * @brief Write frames back through `log` from now on, see `DiskManager::AttachLog`.
+     * Needs COPY mode and no page cleaner; asynchronous write-back is turned off, as it would bypass the log.
+     */
+    void AttachLog(WriteAheadLog *log);
+    /// @brief Store the frames written back compressed where that saves space, see `DiskManager::SetCompression`
+    void SetCompression(bool compressed) { disk_.SetCompression(compressed); }
+    /// @brief Write back every dirty frame, pinned ones included, without evicting them
+    void FlushDirtyFrames();
+    /**
+     * @brief Start a snapshot of the db file to `file_name`, see `DiskManager::BeginSnapshot`; the file must hold a
+     * consistent state, e.g. right after `FlushDirtyFrames` or a commit. Needs COPY mode and synchronous writes.
+     */
+    void BeginSnapshot(const std::string &file_name);
+    auto SnapshotSupported() const -> bool {
+      return mode_ == BufferPoolMode::COPY && !async_ && !cleaner_.joinable();
+    }
+    auto SnapshotStep(size_t size) -> bool { return disk_.SnapshotStep(size); }
+    /// @brief Check about `size` more bytes of the db file, see `DiskManager::ScrubStep`; needs synchronous writes
+    auto ScrubStep(size_t size) -> std::vector<page_id_t>;
 
   private:
-    using frame_id_t = LRUKReplacer::frame_id_t;
+    using frame_id_t = typename Replacer::frame_id_t;
     int info_count_{0};
     const size_t pool_size_;
+    const BufferPoolMode mode_;
+    const bool concurrent_;
     DiskManager<PagesPerFrame> disk_;
-    LRUKReplacer replacer_;
-    std::unordered_map<page_id_t, frame_id_t> page_table_;
+    Replacer replacer_;
+    PageTable page_table_;
     std::vector<Frame<PagesPerFrame> > buffer_;
     std::vector<frame_id_t> free_list_;
+    std::atomic<size_t> pin_budget_; // frames left for `ReservePins`
+    std::unique_ptr<char[]> arena_; // frame buffers, COPY mode only
+    bool async_; // whether write-back and prefetching are asynchronous
+    int write_backs_ = 0; // frames in FrameIO::WRITE_BACK
+    std::vector<AsyncIO::tag_t> reaped_;
+    std::thread cleaner_; // the page cleaner, not joinable if disabled
+    std::mutex latch_; // protects everything above, only taken in concurrent mode or while the cleaner runs
+    std::condition_variable cleaner_cv_; // wakes the cleaner up early to stop it
+    std::condition_variable cleaned_cv_; // signaled when the cleaner has finished a round
+    bool stop_cleaner_ = false;
+    BufferPoolStats stats_;
 
     auto FetchFrame(page_id_t page_id) -> Frame<PagesPerFrame> *;
-    auto UnpinFrame(page_id_t page_id, bool is_dirty) -> bool;
-    auto DeletePage(page_id_t page_id) -> void; // delete regardless of pin count
+    auto UnpinFrame(Frame<PagesPerFrame> *frame) -> bool;
+    auto DeletePage(Frame<PagesPerFrame> *frame) -> void; // the frame is freed once the other pins are dropped
     void FlushAllFrames();
     auto EnsureFreeList() -> bool;
+    void LoadFrame(Frame<PagesPerFrame> &frame, page_id_t page_id); // attach the page data, frame must be free
+    void ReleaseFrame(Frame<PagesPerFrame> &frame); // detach the page data, does not write back
+    /// @brief Write a dirty frame to the file; a ZERO_COPY one is there already and only gets its trailer
+    void WriteBack(Frame<PagesPerFrame> &frame) {
+      if (mode_ == BufferPoolMode::ZERO_COPY) {
+        disk_.SealMapped(frame.GetPageId());
+      } else {
+        disk_.WriteFrame(frame.GetPageId(), frame.GetData());
+      }
+    }
+    auto EnsureFreeListAsync() -> bool;
+    void ReapIO(bool wait); // finish the completed asynchronous requests
+    auto WaitIO(page_id_t page_id) -> frame_id_t; // wait for the frame's request, if any; returns PageTable::Find
+    auto Latch() -> std::unique_lock<std::mutex>; // locks `latch_` in concurrent mode or if the cleaner runs
+    void PinFrame(Frame<PagesPerFrame> *frame); // pin a frame that is already pinned
+    void CleanerLoop();
+    void StopCleaner();
 };
-template<int PagesPerFrame>
-auto BufferPoolManager<PagesPerFrame>::NewFrameGuarded(page_id_t *page_id) -> BasicFrameGuard {
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::NewFrameGuarded(page_id_t *page_id) -> BasicFrameGuard {
+  auto lock = Latch();
   if (!EnsureFreeList()) throw std::runtime_error("No free frame");
   page_id_t page_id_ = disk_.AllocateFrame();
   if (page_id) *page_id = page_id_;
@@ -161,89 +344,334 @@ auto BufferPoolManager<PagesPerFrame>::NewFrameGuarded(page_id_t *page_id) -> Ba
   free_list_.pop_back();
   auto &frame = buffer_[frame_id];
   frame.page_id_ = page_id_;
+  if (mode_ == BufferPoolMode::ZERO_COPY) {
+    // frames taken from the free list are zeroed in COPY mode, keep the same contract here
+    frame.data_ = disk_.FramePtr(page_id_);
+    memset(frame.data_, 0, Frame<PagesPerFrame>::kFrameSize);
+    frame.is_dirty_ = true; // so that it gets its trailer, zeros are only valid above the committed frames
+  }
   ++frame.pin_count_;
-  page_table_[page_id_] = frame_id;
-  replacer_.RecordAccess(page_id_);
+  page_table_.Insert(page_id_, frame_id);
+  replacer_.RecordAccess(frame_id, page_id_);
   return {this, &frame};
 }
-template<int PagesPerFrame>
-auto BufferPoolManager<PagesPerFrame>::FetchFrameBasic(page_id_t page_id) -> BasicFrameGuard {
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::FetchFrameBasic(page_id_t page_id) -> BasicFrameGuard {
+  auto lock = Latch();
   auto frame = FetchFrame(page_id);
   if (frame == nullptr) throw std::runtime_error("No free frame");
   return {this, frame};
 }
-template<int PagesPerFrame>
-bool BufferPoolManager<PagesPerFrame>::EnsureFreeList() {
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::Prefetch(page_id_t page_id) {
+  auto lock = Latch();
+  if (page_id == INVALID_PAGE_ID || page_table_.Contains(page_id)) return;
+  if (!async_) {
+    disk_.Prefetch(page_id);
+    return;
+  }
+  if (!EnsureFreeList()) return;
+  frame_id_t frame_id = free_list_.back();
+  free_list_.pop_back();
+  auto &frame = buffer_[frame_id];
+  frame.page_id_ = page_id;
+  frame.io_ = FrameIO::READ;
+  page_table_.Insert(page_id, frame_id);
+  replacer_.RecordAccess(frame_id, page_id);
+  disk_.ReadFrameAsync(page_id, frame.GetData(), frame_id);
+  disk_.SubmitAsync();
+}
+template<int PagesPerFrame, class Replacer>
+bool BufferPoolManager<PagesPerFrame, Replacer>::EnsureFreeList() {
+  if (async_) return EnsureFreeListAsync();
   if (free_list_.empty()) {
     frame_id_t frame_id;
     if (!replacer_.Evict(&frame_id)) {
       return false;
     }
     auto &frame = buffer_[frame_id];
-    if (frame.IsDirty()) {
-      disk_.WriteFrame(frame.GetPageId(), frame.GetData());
-    }
-    page_table_.erase(frame.GetPageId());
-    frame.Reset();
+    if (frame.IsDirty()) WriteBack(frame);
+    page_table_.Erase(frame.GetPageId());
+    ReleaseFrame(frame);
     free_list_.push_back(frame_id);
   }
   return true;
 }
-template<int PagesPerFrame>
-auto BufferPoolManager<PagesPerFrame>::FetchFrame(page_id_t page_id) -> Frame<PagesPerFrame> * {
-  if (auto it = page_table_.find(page_id); it != page_table_.end()) {
-    auto &frame = buffer_[it->second];
-    replacer_.RecordAccess(page_id);
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::EnsureFreeListAsync() -> bool {
+  if (disk_.AsyncPending() > 0) ReapIO(false);
+  bool submitted = false;
+  while (free_list_.size() + write_backs_ < BPM_CLEAN_RESERVE) {
+    frame_id_t frame_id;
+    if (!replacer_.Evict(&frame_id)) break;
+    auto &frame = buffer_[frame_id];
+    if (frame.IsDirty()) {
+      // stays in the page table until the write completes, so that a fetch in between can keep it
+      frame.is_dirty_ = false;
+      frame.io_ = FrameIO::WRITE_BACK;
+      ++write_backs_;
+      disk_.WriteFrameAsync(frame.GetPageId(), frame.GetData(), frame_id);
+      submitted = true;
+    } else {
+      page_table_.Erase(frame.GetPageId());
+      ReleaseFrame(frame);
+      free_list_.push_back(frame_id);
+    }
+  }
+  if (submitted) disk_.SubmitAsync();
+  while (free_list_.empty() && write_backs_ > 0) {
+    ReapIO(true);
+  }
+  return !free_list_.empty();
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::ReapIO(bool wait) {
+  reaped_.clear();
+  disk_.ReapAsync(&reaped_, wait);
+  for (auto frame_id : reaped_) {
+    auto &frame = buffer_[frame_id];
+    if (frame.io_ == FrameIO::WRITE_BACK) {
+      --write_backs_;
+      page_table_.Erase(frame.GetPageId());
+      ReleaseFrame(frame);
+      free_list_.push_back(frame_id);
+      continue;
+    }
+    if (frame.io_ == FrameIO::READ) disk_.DecodeFrame(frame.GetPageId(), frame.GetData());
+    frame.io_ = FrameIO::NONE;
     if (frame.GetPinCount() == 0) {
-      replacer_.SetNonevictable(it->second);
+      replacer_.SetEvictable(frame_id);
+    }
+  }
+}
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::WaitIO(page_id_t page_id) -> frame_id_t {
+  frame_id_t frame_id = page_table_.Find(page_id);
+  while (frame_id != PageTable::kNotFound && buffer_[frame_id].io_ != FrameIO::NONE && buffer_[frame_id].io_ != FrameIO::CLEAN) {
+    ReapIO(true);
+    frame_id = page_table_.Find(page_id);
+  }
+  return frame_id;
+}
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::FetchFrame(page_id_t page_id) -> Frame<PagesPerFrame> * {
+  if (frame_id_t frame_id = page_table_.Find(page_id); frame_id != PageTable::kNotFound) {
+    auto &frame = buffer_[frame_id];
+    if (frame.io_ == FrameIO::WRITE_BACK) {
+      // fetched again before the write-back completed: keep the frame, but wait for the write, as the caller may
+      // change the frame while the kernel still reads it. Pinned meanwhile, so that the completion leaves it alone
+      frame.io_ = FrameIO::WRITE;
+      --write_backs_;
+      ++frame.pin_count_;
+      WaitIO(page_id);
+      --frame.pin_count_;
+    } else if (frame.io_ == FrameIO::READ) {
+      WaitIO(page_id);
     }
+    if (frame.GetPinCount() == 0) {
+      replacer_.SetNonevictable(frame_id);
+    }
+    replacer_.RecordAccess(frame_id, page_id);
     ++frame.pin_count_;
+    ++stats_.hits;
     return &frame;
   }
+  ++stats_.misses;
   if (!EnsureFreeList()) return nullptr;
   frame_id_t frame_id = free_list_.back();
   free_list_.pop_back();
   auto &frame = buffer_[frame_id];
-  frame.page_id_ = page_id;
-  disk_.ReadFrame(page_id, frame.GetData());
-  page_table_[page_id] = frame_id;
-  replacer_.RecordAccess(page_id);
+  LoadFrame(frame, page_id);
+  page_table_.Insert(page_id, frame_id);
+  replacer_.RecordAccess(frame_id, page_id);
   ++frame.pin_count_;
   return &frame;
 }
-template<int PagesPerFrame>
-auto BufferPoolManager<PagesPerFrame>::UnpinFrame(page_id_t page_id, bool is_dirty) -> bool {
-  if (auto it = page_table_.find(page_id); it != page_table_.end()) {
-    auto &frame = buffer_[it->second];
-    if (frame.GetPinCount() <= 0) {
-      return false;
-    }
-    if (--frame.pin_count_ == 0) {
-      replacer_.SetEvictable(it->second, page_id);
-    }
-    frame.is_dirty_ |= is_dirty;
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::UnpinFrame(Frame<PagesPerFrame> *frame) -> bool {
+  auto lock = Latch();
+  if (frame->GetPinCount() <= 0) {
+    return false;
+  }
+  auto frame_id = static_cast<frame_id_t>(frame - buffer_.data());
+  if (--frame->pin_count_ > 0) {
     return true;
   }
-  return false;
+  if (frame->orphan_) {
+    ReleaseFrame(*frame);
+    free_list_.push_back(frame_id);
+  } else if (frame->io_ == FrameIO::NONE) {
+    // a frame busy with I/O becomes evictable once the request completes
+    replacer_.SetEvictable(frame_id);
+  }
+  return true;
 }
-template<int PagesPerFrame>
-auto BufferPoolManager<PagesPerFrame>::DeletePage(page_id_t page_id) -> void {
-  if (auto it = page_table_.find(page_id); it != page_table_.end()) {
-    auto &frame = buffer_[it->second];
-    frame.Reset();
-    replacer_.Remove(it->second, page_id);
-    free_list_.push_back(it->second);
-    page_table_.erase(it);
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::DeletePage(Frame<PagesPerFrame> *frame) -> void {
+  auto lock = Latch();
+  page_id_t page_id = frame->GetPageId();
+  if (frame->io_ == FrameIO::CLEAN) {
+    // the snapshot must not land after the page is put on the disk free list
+    cleaned_cv_.wait(lock, [frame] { return frame->io_ != FrameIO::CLEAN; });
+  }
+  if (async_) WaitIO(page_id);
+  auto frame_id = static_cast<frame_id_t>(frame - buffer_.data());
+  frame->Bump(); // optimistic readers of the page must not trust what they read
+  page_table_.Erase(page_id);
+  replacer_.Remove(frame_id);
+  if (frame->pin_count_ > 1) {
+    --frame->pin_count_;
+    frame->orphan_ = true;
+  } else {
+    ReleaseFrame(*frame);
+    free_list_.push_back(frame_id);
   }
   disk_.DeallocateFrame(page_id);
 }
-template<int PagesPerFrame>
-void BufferPoolManager<PagesPerFrame>::FlushAllFrames() {
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::AttachLog(WriteAheadLog *log) {
+  if (mode_ != BufferPoolMode::COPY || cleaner_.joinable()) {
+    throw std::runtime_error("A write-ahead log requires a COPY buffer pool without page cleaner");
+  }
+  async_ = false;
+  disk_.AttachLog(log);
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::FlushDirtyFrames() {
+  auto lock = Latch();
+  for (auto &frame : buffer_) {
+    if (frame.IsDirty()) {
+      WriteBack(frame);
+      frame.is_dirty_ = false;
+    }
+  }
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::BeginSnapshot(const std::string &file_name) {
+  if (!SnapshotSupported()) {
+    throw std::runtime_error("A snapshot requires a COPY buffer pool without asynchronous writes");
+  }
+  disk_.BeginSnapshot(file_name);
+}
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::ScrubStep(size_t size) -> std::vector<page_id_t> {
+  if (async_ || cleaner_.joinable() || mode_ == BufferPoolMode::ZERO_COPY) {
+    // a frame half way through a write would fail its checksum, as would a dirty ZERO_COPY one
+    throw std::runtime_error("A scrub requires a buffer pool without asynchronous writes");
+  }
+  return disk_.ScrubStep(size);
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::FlushAllFrames() {
+  if (async_) {
+    // write everything back as one batch
+    for (frame_id_t frame_id = 0; frame_id < static_cast<frame_id_t>(pool_size_); ++frame_id) {
+      auto &frame = buffer_[frame_id];
+      if (frame.IsDirty() && frame.io_ == FrameIO::NONE) {
+        frame.is_dirty_ = false;
+        frame.io_ = FrameIO::WRITE;
+        disk_.WriteFrameAsync(frame.GetPageId(), frame.GetData(), frame_id);
+      }
+    }
+    while (disk_.AsyncPending() > 0) {
+      ReapIO(true);
+    }
+  }
   for (auto &frame : buffer_) {
     ASSERT(frame.GetPinCount() == 0);
     if (frame.IsDirty()) {
-      disk_.WriteFrame(frame.GetPageId(), frame.GetData());
+      WriteBack(frame);
+      frame.is_dirty_ = false;
+    }
+  }
+  if (mode_ == BufferPoolMode::ZERO_COPY) {
+    // evicted frames were never written back explicitly, so sync the whole mapping rather than the resident frames
+    disk_.Sync();
+  }
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::LoadFrame(Frame<PagesPerFrame> &frame, page_id_t page_id) {
+  frame.page_id_ = page_id;
+  if (mode_ == BufferPoolMode::ZERO_COPY) {
+    frame.data_ = disk_.FramePtr(page_id);
+    disk_.VerifyMapped(page_id);
+  } else {
+    disk_.ReadFrame(page_id, frame.GetData());
+  }
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::ReleaseFrame(Frame<PagesPerFrame> &frame) {
+  frame.Reset();
+  if (mode_ == BufferPoolMode::ZERO_COPY) {
+    frame.data_ = nullptr;
+  } else {
+    memset(frame.data_, 0, Frame<PagesPerFrame>::kFrameSize);
+  }
+}
+template<int PagesPerFrame, class Replacer>
+auto BufferPoolManager<PagesPerFrame, Replacer>::Latch() -> std::unique_lock<std::mutex> {
+  return concurrent_ || cleaner_.joinable() ? std::unique_lock(latch_) : std::unique_lock<std::mutex>();
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::PinFrame(Frame<PagesPerFrame> *frame) {
+  auto lock = Latch();
+  ++frame->pin_count_;
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::CleanerLoop() {
+  constexpr int kFrameSize = Frame<PagesPerFrame>::kFrameSize;
+  auto snapshots = std::make_unique<char[]>(BPM_CLEANER_BATCH * kFrameSize);
+  std::vector<frame_id_t> cold;
+  std::vector<std::pair<frame_id_t, page_id_t> > batch;
+  std::unique_lock lock(latch_);
+  while (true) {
+    cleaner_cv_.wait_for(lock, std::chrono::milliseconds(BPM_CLEANER_INTERVAL_MS), [this] { return stop_cleaner_; });
+    if (stop_cleaner_) return;
+    cold.clear();
+    replacer_.Coldest(BPM_CLEANER_SCAN, &cold);
+    batch.clear();
+    for (auto frame_id : cold) {
+      auto &frame = buffer_[frame_id];
+      if (!frame.IsDirty()) continue;
+      // not evictable while being written, so that an eviction cannot write a newer version before us
+      replacer_.SetNonevictable(frame_id);
+      frame.is_dirty_ = false;
+      frame.io_ = FrameIO::CLEAN;
+      memcpy(snapshots.get() + batch.size() * kFrameSize, frame.GetData(), kFrameSize);
+      batch.emplace_back(frame_id, frame.GetPageId());
+      if (batch.size() == BPM_CLEANER_BATCH) break;
+    }
+    if (batch.empty()) continue;
+    lock.unlock();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      disk_.WriteFrameConcurrent(batch[i].second, snapshots.get() + i * kFrameSize);
+    }
+    lock.lock();
+    for (auto [frame_id, page_id] : batch) {
+      auto &frame = buffer_[frame_id];
+      frame.io_ = FrameIO::NONE;
+      if (frame.GetPinCount() > 0) continue;
+      if (!frame.IsDirty() && free_list_.size() < BPM_CLEAN_RESERVE) {
+        // the coldest frames are the next victims anyway, evicting them here takes the work off the command thread
+        page_table_.Erase(page_id);
+        replacer_.Remove(frame_id);
+        ReleaseFrame(frame);
+        free_list_.push_back(frame_id);
+      } else {
+        replacer_.SetEvictable(frame_id);
+      }
     }
+    cleaned_cv_.notify_all();
+  }
+}
+template<int PagesPerFrame, class Replacer>
+void BufferPoolManager<PagesPerFrame, Replacer>::StopCleaner() {
+  if (!cleaner_.joinable()) return;
+  {
+    std::unique_lock lock(latch_);
+    stop_cleaner_ = true;
   }
+  cleaner_cv_.notify_all();
+  cleaner_.join();
 }
 } // namespace storage
@@ -10,16 +10,42 @@ namespace business {
 TicketSystemCLI::TicketSystemCLI(bool force_reset) {
   bool reset = force_reset;
   if (!reset) {
+    TicketSystem::RecoverCompaction(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                    storage::VACANCY_DB_FILE_NAME);
+    TicketSystem::RecoverSnapshot(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                  storage::VACANCY_DB_FILE_NAME);
     std::ifstream file(storage::DB_FILE_NAME);
-    reset = !file.good();
+    std::ifstream scan_file(storage::SCAN_DB_FILE_NAME);
+    std::ifstream vacancy_file(storage::VACANCY_DB_FILE_NAME);
+    reset = !file.good() || !scan_file.good() || !vacancy_file.good();
+  }
+  ticket_system_ = std::make_unique<TicketSystem>(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                                  storage::VACANCY_DB_FILE_NAME, reset);
+  if (ticket_system_->GarbageRatio() > storage::VLS_COMPACT_RATIO) {
+    ticket_system_ = TicketSystem::Compact(std::move(ticket_system_), storage::DB_FILE_NAME,
+                                           storage::SCAN_DB_FILE_NAME, storage::VACANCY_DB_FILE_NAME);
   }
-  ticket_system_ = std::make_unique<TicketSystem>(storage::DB_FILE_NAME, reset);
 }
 void TicketSystemCLI::run() {
+  // With the log, a reply is only written out once the command it answers is committed. A group is committed when
+  // it is due, or as soon as there is no more input to wait for, so that no reply is kept back for long.
+  bool logged = ticket_system_->Logged();
+  if (logged) utils::FastIO::Hold();
+  std::ios::sync_with_stdio(false); // so that in_avail tells whether reading the next command would block
   std::string line;
-  while (std::getline(std::cin, line)) {
+  while (true) {
+    if (logged && std::cin.rdbuf()->in_avail() <= 0) {
+      ticket_system_->CommitGroup();
+      utils::FastIO::Release();
+    }
+    if (!std::getline(std::cin, line)) break;
     auto [command, args] = utils::Parser::Read(line);
-#define ROUTE(cmd) if (command == #cmd) { WriteTimestamp(args); cmd(args); continue; }
+#define ROUTE(cmd) if (command == #cmd) { \
+      WriteTimestamp(args); \
+      cmd(args); \
+      if (ticket_system_->EndCommand()) utils::FastIO::Release(); \
+      continue; \
+    }
     ROUTE(add_user);
     ROUTE(login);
     ROUTE(logout);
@@ -35,6 +61,8 @@ void TicketSystemCLI::run() {
     ROUTE(query_order);
     ROUTE(refund_ticket);
     ROUTE(clean);
+    ROUTE(snapshot);
+    ROUTE(restore);
 #undef ROUTE
     if (command == "exit") {
       WriteTimestamp(args);
@@ -43,6 +71,10 @@ void TicketSystemCLI::run() {
     }
     ASSERT(false); // No such command
   }
+  if (logged) {
+    ticket_system_->CommitGroup();
+    utils::FastIO::Release();
+  }
 }
 void TicketSystemCLI::add_user(const utils::Args& args) {
   int8_t privilege = args.GetFlag('g').empty()
@@ -127,7 +159,26 @@ void TicketSystemCLI::refund_ticket(const utils::Args& args) {
   ticket_system_->RefundTicket(args.GetFlag('u'), order_no);
 }
 void TicketSystemCLI::clean(const utils::Args& args) {
-  ticket_system_ = std::make_unique<TicketSystem>(storage::DB_FILE_NAME, true);
+  ticket_system_.reset(); // shut the old files and log down before they are truncated
+  ticket_system_ = std::make_unique<TicketSystem>(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                                  storage::VACANCY_DB_FILE_NAME, true);
+  utils::FastIO::WriteSuccess();
+}
+void TicketSystemCLI::snapshot(const utils::Args& args) {
+  if (!ticket_system_->BeginSnapshot()) {
+    return utils::FastIO::WriteFailure();
+  }
+  utils::FastIO::WriteSuccess();
+}
+void TicketSystemCLI::restore(const utils::Args& args) {
+  ticket_system_.reset(); // the files are replaced under it
+  bool restored = TicketSystem::RestoreSnapshot(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                                storage::VACANCY_DB_FILE_NAME);
+  ticket_system_ = std::make_unique<TicketSystem>(storage::DB_FILE_NAME, storage::SCAN_DB_FILE_NAME,
+                                                  storage::VACANCY_DB_FILE_NAME);
+  if (!restored) {
+    return utils::FastIO::WriteFailure();
+  }
   utils::FastIO::WriteSuccess();
 }
 void TicketSystemCLI::exit(const utils::Args& args) {
@@ -74,6 +74,14 @@ class TicketSystemCLI {
     /// @return void, outputs 0 on success
     void clean(const utils::Args &args);
 
+    /// @brief format: [timestamp] snapshot
+    /// @return void, outputs 0 once an online snapshot of the db has started, -1 if one is in progress
+    void snapshot(const utils::Args &args);
+
+    /// @brief format: [timestamp] restore
+    /// @return void, outputs 0 once the db is replaced by the last complete snapshot, -1 if there is none
+    void restore(const utils::Args &args);
+
     /// @brief format: [timestamp] exit
     /// @return void, outputs "bye"
     static void exit(const utils::Args &args);
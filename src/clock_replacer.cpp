@@ -0,0 +1,63 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#include "clock_replacer.h"
+
+namespace storage {
+ClockReplacer::ClockReplacer(size_t pool_size) : pool_size_(static_cast<frame_id_t>(pool_size)),
+                                                 referenced_(pool_size, 0), evictable_(pool_size, 0) {
+}
+auto ClockReplacer::Evict(frame_id_t *frame_id) -> bool {
+  if (size_ == 0) {
+    return false;
+  }
+  // terminates within two sweeps: the first one clears every bit it passes
+  while (true) {
+    frame_id_t current = hand_;
+    hand_ = hand_ + 1 == pool_size_ ? 0 : hand_ + 1;
+    if (!evictable_[current]) continue;
+    if (referenced_[current]) {
+      referenced_[current] = 0;
+      continue;
+    }
+    evictable_[current] = 0;
+    --size_;
+    *frame_id = current;
+    return true;
+  }
+}
+auto ClockReplacer::RecordAccess(frame_id_t frame_id, page_id_t) -> void {
+  referenced_[frame_id] = 1;
+}
+void ClockReplacer::SetEvictable(frame_id_t frame_id) {
+  if (!evictable_[frame_id]) {
+    evictable_[frame_id] = 1;
+    ++size_;
+  }
+}
+void ClockReplacer::SetNonevictable(frame_id_t frame_id) {
+  if (evictable_[frame_id]) {
+    evictable_[frame_id] = 0;
+    --size_;
+  }
+}
+void ClockReplacer::Remove(frame_id_t frame_id) {
+  SetNonevictable(frame_id);
+  referenced_[frame_id] = 0;
+}
+auto ClockReplacer::Size() const -> size_t {
+  return size_;
+}
+void ClockReplacer::Coldest(size_t n, std::vector<frame_id_t> *frames) const {
+  // the frames the hand would take on its first sweep, then the ones it would take on the second
+  for (int referenced = 0; referenced <= 1; ++referenced) {
+    for (frame_id_t i = 0, it = hand_; i < pool_size_ && n > 0; ++i, it = it + 1 == pool_size_ ? 0 : it + 1) {
+      if (evictable_[it] && referenced_[it] == referenced) {
+        frames->push_back(it);
+        --n;
+      }
+    }
+  }
+}
+} // namespace storage
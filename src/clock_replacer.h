@@ -0,0 +1,44 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#pragma once
+#include <config.h>
+#include <cstdint>
+#include <vector>
+
+namespace storage {
+/**
+ * @brief CLOCK (second chance) replacement.
+ *
+ * Every frame has a reference bit, set on access. The hand sweeps the frames, clearing set bits,
+ * and evicts the first evictable frame whose bit is already clear.
+ */
+class ClockReplacer {
+  public:
+    using frame_id_t = int;
+    explicit ClockReplacer(size_t pool_size);
+
+    auto Evict(frame_id_t *frame_id) -> bool;
+
+    auto RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void;
+
+    void SetEvictable(frame_id_t frame_id);
+
+    void SetNonevictable(frame_id_t frame_id);
+
+    void Remove(frame_id_t frame_id);
+
+    auto Size() const -> size_t;
+
+    /// @brief Append up to `n` evictable frames, roughly in the order they would be evicted
+    void Coldest(size_t n, std::vector<frame_id_t> *frames) const;
+
+  private:
+    const frame_id_t pool_size_;
+    frame_id_t hand_ = 0;
+    size_t size_ = 0;
+    std::vector<uint8_t> referenced_;
+    std::vector<uint8_t> evictable_;
+};
+} // namespace storage
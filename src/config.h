@@ -10,6 +10,7 @@
 namespace storage {
 
 static constexpr int PAGE_SIZE = 4096;
+static constexpr int CACHE_LINE_SIZE = 64;
 
 using page_id_t = int32_t;
 static constexpr page_id_t INVALID_PAGE_ID = -1;
@@ -17,17 +18,123 @@ static constexpr page_id_t INVALID_PAGE_ID = -1;
 //static constexpr int BPT_MAX_DEGREE = 100; // For testing purpose, will have no effect if set to infinity
 static constexpr int BPT_MAX_DEGREE = std::numeric_limits<int>::max(); // For testing purpose, will have no effect if set to infinity
 static constexpr int BPT_PAGES_PER_FRAME = 1;
+// Frames of the scan-heavy trees (station -> trains, user -> orders), which live in a buffer pool and db file of
+// their own: a scan then reads a quarter as many frames, while point lookups keep their 4 KiB frames.
+static constexpr int BPT_SCAN_PAGES_PER_FRAME = 4;
+// Descend through the pinned upper levels by pointer, see BPlusTree. Off: the trees here are shallow and their upper
+// levels stay resident anyway, so it gains nothing measurable (3.30 vs 3.37 s on the test workloads, within noise).
+// Only changes how descents cross the tier; BPT_PINNED_LEVELS keeps it pinned either way.
+static constexpr bool BPT_SWIZZLE = false;
+static constexpr double BPT_BULK_LOAD_FILL = 0.9; // default share of a frame that BPlusTree::BulkLoad fills
+static constexpr int BPT_PINNED_LEVELS = 2; // levels, counted from the root, that a tree keeps pinned by default
+static constexpr int BPT_PREFETCH_LEAVES = 16; // most leaves a B+ tree iterator prefetches ahead of its scan
+// Optimistic latching, so that several threads can use a tree at once; needs a BPM_CONCURRENT buffer pool. The ticket
+// system stays single-threaded, so it only pays for the latches with this on.
+static constexpr bool BPT_CONCURRENT = false;
+enum class KeySearch : uint8_t {
+  BINARY = 0, // branchless binary search over the whole frame
+  SIMD = 1, // binary search down to a block of keys, counted with AVX-512 / AVX2 compares; 8-byte keys only
+  INTERPOLATION = 2, // hash_t keys start from the position the key range predicts, the others are as SIMD
+};
+static constexpr KeySearch BPT_KEY_SEARCH = KeySearch::SIMD; // see key_search.h
+enum class InternalLayout : uint8_t {
+  SORTED = 0, // one sorted array of keys
+  BLOCKED = 1, // sorted keys plus the first key of every cache line of them, see BPlusTreeInternalFrame
+};
+static constexpr InternalLayout BPT_INTERNAL_LAYOUT = InternalLayout::BLOCKED; // default of `BPlusTree`
+// Leaves of PackedPair keys store each `first` once per run, see BPlusTreePackedLeafFrame: nearly twice the entries
+// per leaf, but a scan pays for decoding them (PartialSearch of every station 1.79 vs 1.39 ms), so it is off. Changes
+// the leaf format: a db written with one setting cannot be opened with the other.
+static constexpr bool BPT_PACKED_LEAVES = false;
 
 using record_id_t = int32_t;
 static constexpr record_id_t INVALID_RECORD_ID = -1;
 static constexpr int VLS_PAGES_PER_FRAME = 1;
+// Frames of the store of vacancy matrices, which lives in a buffer pool and db file of its own: a matrix covers all
+// the days a train is on sale, up to 99 * 92 ints for a train of 100 stations.
+static constexpr int VLS_VACANCY_PAGES_PER_FRAME = 9;
+// Vacancy matrices are mostly runs of equal seat counts: their frames are stored compressed, see DiskManager.
+// Needs PAGE_CHECKSUM_ENABLED.
+static constexpr bool VLS_VACANCY_COMPRESSION = true;
+static constexpr double VLS_COMPACT_RATIO = 0.25; // the db is compacted on startup once this share of the VLS is free
 
 using hash_t = uint64_t;
 
 static constexpr int LRU_REPLACER_K = 10;
-static constexpr int BUFFER_POOL_SIZE = 2500;
+static constexpr int BUFFER_POOL_SIZE = 2500; // frames of one page; the ticket system splits them between its pools
+static constexpr double BPM_SCAN_POOL_SHARE = 0.25; // share of BUFFER_POOL_SIZE for the BPT_SCAN_PAGES_PER_FRAME pool
+static constexpr double BPM_VACANCY_POOL_SHARE = 0.25; // share of BUFFER_POOL_SIZE for the vacancy matrices
+static constexpr double BPM_PIN_BUDGET = 0.25; // share of the pool that all B+ trees together may keep pinned
+static constexpr bool BPM_CONCURRENT = false; // latch every pool operation, so that several threads can share the pool
+
+enum class ReplacerPolicy : uint8_t {
+  LRU_K = 0,
+  CLOCK = 1,
+  TWO_Q = 2, // scan resistant: pages seen once go through a FIFO of their own
+  ARC = 3, // scan resistant, balances recency and frequency by itself
+};
+static constexpr ReplacerPolicy BUFFER_POOL_REPLACER = ReplacerPolicy::LRU_K; // default of `BufferPoolManager`
+static constexpr double TWO_Q_IN_RATIO = 0.25; // share of the pool for pages seen once (A1in)
+static constexpr double TWO_Q_OUT_RATIO = 0.5; // pages remembered after leaving A1in (A1out), relative to the pool size
+
+enum class BufferPoolMode : uint8_t {
+  COPY = 0, // frames own a copy of the page, written back on eviction
+  ZERO_COPY = 1, // frames point into the mapping of the MMAP backend, synced with msync on flush
+};
+static constexpr BufferPoolMode BUFFER_POOL_MODE = BufferPoolMode::COPY;
 
 static constexpr char DB_FILE_NAME[] = "db.bin";
+static constexpr char SCAN_DB_FILE_NAME[] = "db_scan.bin"; // frames of BPT_SCAN_PAGES_PER_FRAME pages
+static constexpr char VACANCY_DB_FILE_NAME[] = "db_vacancy.bin"; // frames of VLS_VACANCY_PAGES_PER_FRAME pages
+
+enum class DiskBackend : uint8_t {
+  FSTREAM = 0, // seek + read / write through std::fstream
+  MMAP = 1, // the db file is mapped into memory, frames are served by memcpy
+};
+static constexpr DiskBackend DISK_BACKEND = DiskBackend::MMAP;
+static constexpr int MMAP_GROW_FRAMES = 256; // the db file is grown by this many frames at a time
+static constexpr size_t MMAP_RESERVE_SIZE = size_t(1) << 36; // address space reserved for the mapping, caps the db size
+static constexpr size_t MMAP_WILLNEED_SIZE = size_t(64) << 20; // prefetch up to this many bytes of an existing db on open
+
+enum class AsyncIOBackend : uint8_t {
+  NONE = 0, // all reads and writes are synchronous
+  IO_URING = 1, // falls back to THREAD_POOL if the kernel refuses io_uring
+  THREAD_POOL = 2, // pread / pwrite on worker threads
+};
+// Pays off once the db outgrows the page cache; while it fits, the extra syscalls cost more than they hide.
+static constexpr AsyncIOBackend ASYNC_IO_BACKEND = AsyncIOBackend::NONE;
+static constexpr int ASYNC_IO_QUEUE_DEPTH = 64; // max requests in flight
+static constexpr int ASYNC_IO_THREADS = 2; // workers of the THREAD_POOL backend
+static constexpr int BPM_CLEAN_RESERVE = 16; // free frames the buffer pool keeps ready, dirty victims are written back in the background
+
+// The page cleaner writes cold dirty frames from a background thread, so that eviction rarely has to write.
+// It needs a spare core: on a single one, the latch and the extra writes cost more than they save.
+static constexpr bool BPM_CLEANER_ENABLED = false;
+static constexpr int BPM_CLEANER_INTERVAL_MS = 5; // pause between two rounds of the page cleaner
+static constexpr int BPM_CLEANER_SCAN = 256; // a round looks at this many of the coldest evictable frames
+static constexpr int BPM_CLEANER_BATCH = 32; // at most this many frames are written per round, bounds the write rate
+
+// Redo log of the frames written back, shared by the db files of a ticket system, see WriteAheadLog. Replies are
+// kept back until their commands commit, see TicketSystemCLI::run. Opt-in: the log writes every frame twice and
+// syncs it, which makes a run about half again as long. Needs the COPY buffer pool mode without the page cleaner;
+// asynchronous write-back is turned off with it.
+static constexpr bool WAL_ENABLED = false;
+static constexpr char WAL_FILE_SUFFIX[] = ".wal"; // the log is named after the main db file
+static constexpr int WAL_GROUP_COMMANDS = 10000; // a group commit is due after this many commands...
+static constexpr int WAL_GROUP_INTERVAL_MS = 1000; // ...or this long after the first command of the group
+// A checkpoint starts once the log passes WAL_CHECKPOINT_SIZE or WAL_CHECKPOINT_INTERVAL_MS after the last one; it
+// syncs the db files in the background, then drops the log behind it. Smaller values bound the restart time tighter.
+static constexpr size_t WAL_CHECKPOINT_SIZE = size_t(64) << 20;
+static constexpr int WAL_CHECKPOINT_INTERVAL_MS = 30000;
+
+// Every frame ends in a CRC32C of the rest, set when it is written to the db file and checked when it is read back,
+// see DiskManager; frames give up the 4 bytes to it. Changes the file format.
+static constexpr bool PAGE_CHECKSUM_ENABLED = true;
+// With checksums, each db file checks this many bytes of its frames per command, over and over, and reports the
+// corrupt ones on stderr; 0 turns the scrub off. Needs the COPY buffer pool mode.
+static constexpr size_t SCRUB_STEP_SIZE = 0;
+
+static constexpr size_t SNAPSHOT_STEP_SIZE = size_t(64) << 10; // bytes each db file copies to its snapshot per command
 
 } // namespace storage
 
@@ -38,7 +145,5 @@ using abs_time_t = int32_t; // 0 ~ 92 * 1440 - 1, (0: 06-01 00:00, 92 * 1440 - 1
 using order_no_t = int16_t; // 0 ~ 32767
 
 static constexpr date_t MAX_DATE = 92;
-static constexpr size_t DATE_BATCH_SIZE = 10; // the number of days in a Vacancy var_length_object
-static constexpr size_t DATE_BATCH_COUNT = (MAX_DATE + DATE_BATCH_SIZE - 1) / DATE_BATCH_SIZE; // the number of Vacancy var_length_object in TrainInfo
 
 } // namespace business
@@ -0,0 +1,82 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#include "crc32c.h"
+
+#include <cstring>
+#ifdef __SSE4_2__
+#include <immintrin.h>
+#endif
+
+namespace storage {
+namespace {
+constexpr uint32_t kPolynomial = 0x82f63b78; // Castagnoli, bit-reflected: bit 31 is x^0
+
+/// @return a * b mod P, both bit-reflected
+constexpr auto MultiplyMod(uint32_t a, uint32_t b) -> uint32_t {
+  uint32_t product = 0;
+  for (uint32_t bit = uint32_t(1) << 31; bit != 0; bit >>= 1) {
+    if (a & bit) product ^= b;
+    b = b & 1 ? b >> 1 ^ kPolynomial : b >> 1;
+  }
+  return product;
+}
+/// @return x^n mod P, bit-reflected
+constexpr auto XPowMod(uint64_t n) -> uint32_t {
+  uint32_t result = uint32_t(1) << 31, power = uint32_t(1) << 30; // 1 and x
+  for (; n != 0; n >>= 1) {
+    if (n & 1) result = MultiplyMod(power, result);
+    power = MultiplyMod(power, power);
+  }
+  return result;
+}
+
+// The crc32 instruction takes 3 cycles but can start every cycle, so three independent streams over consecutive
+// stripes run three times as fast as one; 3 stripes of 1360 bytes cover a page less its checksum.
+constexpr size_t kStripe = 1360;
+// Shifting a CRC over n bytes multiplies it by x^(8n): a carry-less multiply by x^(8n - 33), which the crc32
+// instruction then reduces, as it multiplies by x^32 and the product comes out one degree up.
+constexpr uint64_t kShiftOne = XPowMod(8 * kStripe - 33);
+constexpr uint64_t kShiftTwo = XPowMod(16 * kStripe - 33);
+} // namespace
+
+auto Crc32c(const char *data, size_t size) -> uint32_t {
+  uint64_t crc = 0xffffffff;
+  size_t i = 0;
+#ifdef __SSE4_2__
+  auto word = [data](size_t pos) {
+    uint64_t word;
+    memcpy(&word, data + pos, sizeof(uint64_t));
+    return word;
+  };
+#ifdef __PCLMUL__
+  for (; i + 3 * kStripe <= size; i += 3 * kStripe) {
+    uint64_t crc1 = 0, crc2 = 0;
+    for (size_t pos = i; pos < i + kStripe; pos += 8) {
+      crc = _mm_crc32_u64(crc, word(pos));
+      crc1 = _mm_crc32_u64(crc1, word(pos + kStripe));
+      crc2 = _mm_crc32_u64(crc2, word(pos + 2 * kStripe));
+    }
+    __m128i shifted = _mm_xor_si128(_mm_clmulepi64_si128(_mm_cvtsi64_si128(crc), _mm_cvtsi64_si128(kShiftTwo), 0),
+                                    _mm_clmulepi64_si128(_mm_cvtsi64_si128(crc1), _mm_cvtsi64_si128(kShiftOne), 0));
+    crc = _mm_crc32_u64(0, _mm_cvtsi128_si64(shifted)) ^ crc2;
+  }
+#endif
+  for (; i + 8 <= size; i += 8) {
+    crc = _mm_crc32_u64(crc, word(i));
+  }
+  for (; i < size; ++i) {
+    crc = _mm_crc32_u8(static_cast<uint32_t>(crc), data[i]);
+  }
+#else
+  for (; i < size; ++i) {
+    crc ^= static_cast<uint8_t>(data[i]);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = crc >> 1 ^ (kPolynomial & -(crc & 1));
+    }
+  }
+#endif
+  return static_cast<uint32_t>(crc) ^ 0xffffffff;
+}
+} // namespace storage
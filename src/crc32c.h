@@ -0,0 +1,17 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace storage {
+/**
+ * @brief CRC32C (Castagnoli) of `size` bytes, as in iSCSI and ext4: initial value and final xor ~0.
+ * Computed with the SSE4.2 crc32 instruction, 8 bytes at a time in three interleaved streams that a carry-less
+ * multiply (PCLMUL) joins; without SSE4.2 it falls back to a bitwise loop.
+ */
+auto Crc32c(const char *data, size_t size) -> uint32_t;
+} // namespace storage
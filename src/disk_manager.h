@@ -3,39 +3,197 @@
 //
 
 #pragma once
+#include <async_io.h>
 #include <config.h>
+#include <crc32c.h>
+#include <frame_codec.h>
+#include <write_ahead_log.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 #include "marcos.h"
 
 namespace storage {
+/**
+ * @brief Reads and writes frames of the db file.
+ *
+ * File layout: one info page followed by `size_` frames of `PagesPerFrame` pages each.
+ * Two backends are available:
+ * - FSTREAM: every access is a seek + read / write through std::fstream.
+ * - MMAP: the whole file is mapped once (a `MMAP_RESERVE_SIZE` range is reserved so the mapping never moves),
+ *   grown with ftruncate by `MMAP_GROW_FRAMES` frames at a time, and frames are served by memcpy.
+ * With either backend, frames can also be read and written asynchronously through `ASYNC_IO_BACKEND`,
+ * and written from another thread through `WriteFrameConcurrent`.
+ * Once a `WriteAheadLog` is attached, `WriteFrame` and `DeallocateFrame` go to the log, which applies them to the
+ * file when they commit; the asynchronous and concurrent writes bypass it, and must not be used then.
+ * A snapshot copies the file as it is at `BeginSnapshot` to another db file, a few frames at a time, while frames
+ * are still written: a frame is copied before it is first overwritten. Writes through `FramePtr`, the asynchronous
+ * and the concurrent ones bypass this as well.
+ * With `PAGE_CHECKSUM_ENABLED`, the last 4 bytes of every frame hold a CRC32C of the rest. Every write sets it, in the
+ * caller's buffer, before the frame leaves for the log or the file; every read from the file checks it, so that a
+ * torn write or a corrupt disk surfaces as an exception instead of a broken tree. A frame that is all zeros, which
+ * the file holds until a frame is first written, passes as well, but only at or above the committed frame count.
+ * `ScrubStep` checks the whole file a few frames at a time. Writes through `FramePtr` bypass this: their frames
+ * get the trailer from `SealMapped`, and are checked by `VerifyMapped`.
+ * With `SetCompression`, a frame applied to the file is stored compressed, see frame_codec.h, if that saves a page:
+ * a header and the code fill the start of its slot, and the rest of the slot is punched out of the file, so that
+ * frames keep their offsets while the file holds only the pages they need. The asynchronous and the concurrent
+ * writes store frames as they are. Reads tell the two apart by the header, and by the checksum should a frame
+ * stored as is start like a header; compression thus needs `PAGE_CHECKSUM_ENABLED`.
+ */
 template<int PagesPerFrame>
-class DiskManager {
+class DiskManager : public LogTarget {
   public:
-    explicit DiskManager(std::string db_file, bool reset);
+    explicit DiskManager(std::string db_file, bool reset, DiskBackend backend = DISK_BACKEND);
     ~DiskManager();
     void ShutDown();
-    void WriteFrame(page_id_t page_id, const char *page_data);
+    /// @brief Write a frame, setting its checksum trailer first
+    void WriteFrame(page_id_t page_id, char *page_data);
     void ReadFrame(page_id_t page_id, char *page_data);
     unsigned int AllocateFrame();
     void DeallocateFrame(page_id_t page_id);
     int &GetInfo(int index);
+    auto GetBackend() const -> DiskBackend { return backend_; }
+    /// @brief Pointer to the frame inside the mapping, only available with the MMAP backend
+    auto FramePtr(page_id_t page_id) -> char *;
+    /// @brief Hint that the frame will be read soon, no-op with the FSTREAM backend
+    void Prefetch(page_id_t page_id);
+    /// @brief Write the frames modified through `FramePtr` back to the file
+    void Sync();
+    /// @brief Set the trailer of a frame modified through `FramePtr`
+    void SealMapped(page_id_t page_id) { SetChecksum(FramePtr(page_id)); }
+    /// @brief Check a frame before it is used through `FramePtr`, decompressing it in place if it is stored so
+    void VerifyMapped(page_id_t page_id) { DecodeFrame(page_id, FramePtr(page_id)); }
+    /**
+     * @brief Write a frame from another thread, while the owner of the manager keeps using it.
+     * Nobody else may read or write the same frame until this returns.
+     */
+    void WriteFrameConcurrent(page_id_t page_id, char *page_data);
+
+    auto AsyncEnabled() const -> bool { return async_ != nullptr; }
+    /// @brief Queue a write; the checksum is set now, so `page_data` must stay untouched until `tag` is reaped
+    void WriteFrameAsync(page_id_t page_id, char *page_data, AsyncIO::tag_t tag);
+    /// @brief Queue a read, `page_data` must not be used until `tag` is reaped, then passed to `DecodeFrame`
+    void ReadFrameAsync(page_id_t page_id, char *page_data, AsyncIO::tag_t tag);
+    /// @brief Start the queued requests
+    void SubmitAsync() { async_->Submit(); }
+    /// @brief Append the tags of finished requests, blocking for at least one if `wait`
+    void ReapAsync(std::vector<AsyncIO::tag_t> *tags, bool wait) { async_->Reap(tags, wait); }
+    /// @brief Number of asynchronous requests whose tags have not been reaped
+    auto AsyncPending() const -> int { return async_->Pending(); }
+
+    /// @brief Decompress a frame read from the file in place if it is stored compressed; throw if it is corrupt
+    void DecodeFrame(page_id_t page_id, char *page_data);
+    /// @brief Check about `size` more bytes of frames, from where the last step stopped; @return the corrupt ones
+    auto ScrubStep(size_t size) -> std::vector<page_id_t>;
+
+    /// @brief Store the frames applied from now on compressed where that saves space; all frames can be read anyway
+    void SetCompression(bool compressed) {
+      if (compressed && !PAGE_CHECKSUM_ENABLED) {
+        throw std::runtime_error("Compressed frames need page checksums");
+      }
+      compressed_ = compressed;
+    }
+
+    void AttachLog(WriteAheadLog *log) {
+      log_ = log;
+      log_file_id_ = log->Attach(this);
+    }
+    auto FrameSize() const -> size_t override { return kFrameSize; }
+    auto InfoData() -> const char * override;
+    void ApplyFrame(page_id_t page_id, const char *data) override;
+    void ApplyInfo(const char *info) override;
+    void StartSync() override;
+    void SyncFile() override;
+
+    /// @brief Start copying the file, as it is now, to `file_name`; writes thereafter must go through `ApplyFrame`
+    void BeginSnapshot(const std::string &file_name);
+    /// @brief Copy about `size` more bytes of frames to the snapshot; @return whether it is complete and synced
+    auto SnapshotStep(size_t size) -> bool;
 
   private:
     static constexpr int kFrameSize = PAGE_SIZE * PagesPerFrame;
     static constexpr int kInfoSize = PAGE_SIZE / sizeof(int);
     using InfoPage = int[kInfoSize];
     std::string db_file_;
+    DiskBackend backend_;
     std::fstream db_io_;
+    int fd_ = -1; // the mapped file with MMAP, a second descriptor for asynchronous and concurrent writes with FSTREAM
+    char *map_ = nullptr; // MMAP only
+    int capacity_ = 0; // MMAP only, number of frames the file can hold without growing
     int size_; // number of frames
     InfoPage info_page_{};
     int &free_head = info_page_[0];
+    // the frame count, which the size of the file no longer tells once growing or a crash left slack behind
+    int &frame_count_ = info_page_[kInfoSize - 1];
+    std::unique_ptr<AsyncIO> async_;
+    WriteAheadLog *log_ = nullptr;
+    int log_file_id_ = -1;
+    int snapshot_fd_ = -1; // -1 if no snapshot is in progress
+    int snapshot_size_ = 0; // frames in the snapshot
+    int snapshot_next_ = 0; // frames below are copied to the snapshot
+    std::vector<bool> snapshot_copied_; // of the frames from `snapshot_next_` on, copied before being overwritten
+    page_id_t scrub_next_ = 0; // the frame the next scrub step starts from
+    size_t scrub_credit_ = 0; // bytes the scrub steps were given but did not check yet, less than a frame
+    std::vector<char> scrub_buffer_;
+    bool compressed_ = false;
+    std::vector<char> codec_buffer_ = std::vector<char>(kFrameSize); // a frame as it is stored, to and from the codec
+    std::vector<char> link_buffer_; // a free frame and its link, see `AllocateFrame` and `DeallocateFrame`
 
-    static int toOffset(page_id_t page_id);
+    static auto toOffset(page_id_t page_id) -> size_t;
+    static auto FileSize(int frame_count) -> size_t { return toOffset(frame_count); }
+    void OpenMapped(bool reset);
+    void EnsureCapacity(int frame_count);
+    /// @brief Copy the frame to the snapshot before it is overwritten, unless it is copied already
+    void SaveForSnapshot(page_id_t page_id) {
+      if (snapshot_fd_ >= 0 && page_id < snapshot_size_ && !snapshot_copied_[page_id]) CopyToSnapshot(page_id);
+    }
+    void CopyToSnapshot(page_id_t page_id);
+    static constexpr int kChecksumOffset = kFrameSize - sizeof(uint32_t);
+    static void SetChecksum(char *data) {
+      if constexpr (PAGE_CHECKSUM_ENABLED) {
+        uint32_t crc = Crc32c(data, kChecksumOffset);
+        memcpy(data + kChecksumOffset, &crc, sizeof(uint32_t));
+      }
+    }
+    /// @brief Check the trailer; a frame of zeros passes only where no frame was committed yet, see `frame_count_`
+    auto ChecksumValid(page_id_t page_id, const char *data) const -> bool;
+    struct CompressedHeader {
+      uint32_t magic;
+      uint32_t size; // of the code that follows
+    };
+    static constexpr uint32_t kCompressedMagic = 0x5a435246;
+    /// @return Whether the frame as stored starts with a `CompressedHeader`
+    static auto LooksCompressed(const char *stored) -> bool;
+    /// @brief Compress the frame into `codec_buffer_`; @return the bytes to store, kFrameSize if it is stored as is
+    auto Encode(const char *data) -> size_t;
+    /// @brief Turn a frame as stored in the file into `frame`, another buffer; @return false if it is corrupt
+    auto Decode(page_id_t page_id, const char *stored, char *frame) -> bool;
+    auto DecodeInPlace(page_id_t page_id, char *frame) -> bool;
+    /// @brief Store the frame, compressed if that saves space
+    void Store(page_id_t page_id, const char *data);
+    /// @brief Read the frame straight from the file, a frame past its end reads as zeros
+    void ReadFromFile(page_id_t page_id, char *data);
 };
 template<int PagesPerFrame>
-DiskManager<PagesPerFrame>::DiskManager(std::string db_file, bool reset) : db_file_(std::move(db_file)) {
+DiskManager<PagesPerFrame>::DiskManager(std::string db_file, bool reset, DiskBackend backend)
+  : db_file_(std::move(db_file)), backend_(backend) {
+  if (backend_ == DiskBackend::MMAP) {
+    OpenMapped(reset);
+    async_ = AsyncIO::Create(fd_, ASYNC_IO_BACKEND);
+    return;
+  }
   if (reset) {
     db_io_.open(db_file_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
     memset(info_page_, 0, sizeof(InfoPage));
@@ -46,11 +204,54 @@ DiskManager<PagesPerFrame>::DiskManager(std::string db_file, bool reset) : db_fi
     db_io_.open(db_file_, std::ios::in | std::ios::out | std::ios::binary);
     db_io_.read(reinterpret_cast<char *>(info_page_), sizeof(InfoPage));
     db_io_.seekg(0, std::ios::end);
-    size_ = (db_io_.tellg() / PAGE_SIZE - 1) / PagesPerFrame;
+    size_ = frame_count_ > 0 ? frame_count_ : (db_io_.tellg() / PAGE_SIZE - 1) / PagesPerFrame;
   }
   if (!db_io_.is_open()) {
     throw std::runtime_error("Cannot open file " + db_file_);
   }
+  // a second descriptor on the same file, writes through the stream are flushed right away so that they stay ordered
+  fd_ = open(db_file_.c_str(), O_RDWR);
+  if (fd_ < 0) {
+    throw std::runtime_error("Cannot open file " + db_file_);
+  }
+  async_ = AsyncIO::Create(fd_, ASYNC_IO_BACKEND);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::OpenMapped(bool reset) {
+  fd_ = open(db_file_.c_str(), O_RDWR | O_CREAT | (reset ? O_TRUNC : 0), 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Cannot open file " + db_file_);
+  }
+  off_t file_size = lseek(fd_, 0, SEEK_END);
+  if (reset || file_size < static_cast<off_t>(sizeof(InfoPage))) {
+    size_ = 0;
+    capacity_ = 0;
+    if (ftruncate(fd_, FileSize(0)) != 0) {
+      throw std::runtime_error("Cannot resize file " + db_file_);
+    }
+  } else {
+    size_ = (file_size / PAGE_SIZE - 1) / PagesPerFrame;
+    capacity_ = size_;
+  }
+  void *map = mmap(nullptr, MMAP_RESERVE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Cannot map file " + db_file_);
+  }
+  map_ = static_cast<char *>(map);
+  // B+ tree and VLS accesses are random, so sequential read-ahead only pollutes the page cache.
+  madvise(map_, MMAP_RESERVE_SIZE, MADV_RANDOM);
+  if (reset || file_size < static_cast<off_t>(sizeof(InfoPage))) {
+    memset(info_page_, 0, sizeof(InfoPage));
+    free_head = INVALID_PAGE_ID;
+  } else {
+    memcpy(info_page_, map_, sizeof(InfoPage));
+    if (frame_count_ > 0) {
+      size_ = frame_count_;
+      EnsureCapacity(size_);
+    }
+    // Warm up the page cache so that the first queries after a restart do not fault page by page.
+    madvise(map_, std::min<size_t>(file_size, MMAP_WILLNEED_SIZE), MADV_WILLNEED);
+  }
 }
 template<int PagesPerFrame>
 DiskManager<PagesPerFrame>::~DiskManager() {
@@ -58,32 +259,86 @@ DiskManager<PagesPerFrame>::~DiskManager() {
 }
 template<int PagesPerFrame>
 void DiskManager<PagesPerFrame>::ShutDown() {
+  async_.reset(); // waits for the requests in flight
+  if (snapshot_fd_ >= 0) {
+    close(snapshot_fd_); // an unfinished snapshot is abandoned
+    snapshot_fd_ = -1;
+  }
+  if (backend_ == DiskBackend::MMAP) {
+    if (map_ == nullptr) return;
+    frame_count_ = size_;
+    memcpy(map_, info_page_, sizeof(InfoPage));
+    munmap(map_, MMAP_RESERVE_SIZE);
+    map_ = nullptr;
+    // drop the slack left by growing in chunks, so that the frame count can be recovered from the file size
+    if (ftruncate(fd_, FileSize(size_)) != 0) {
+      std::cerr << "Cannot shrink file " << db_file_ << std::endl;
+    }
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  if (!db_io_.is_open()) return;
+  frame_count_ = size_;
   db_io_.seekp(0, std::ios::beg);
   db_io_.write(reinterpret_cast<char *>(info_page_), sizeof(InfoPage));
   db_io_.close();
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
 }
 template<int PagesPerFrame>
-void DiskManager<PagesPerFrame>::WriteFrame(page_id_t page_id, const char *page_data) {
+void DiskManager<PagesPerFrame>::WriteFrame(page_id_t page_id, char *page_data) {
   ASSERT(page_id >= 0 && page_id < size_);
-  db_io_.seekp(toOffset(page_id));
-  db_io_.write(page_data, kFrameSize);
+  SetChecksum(page_data);
+  if (log_ != nullptr) {
+    log_->Append(log_file_id_, page_id, page_data);
+    return;
+  }
+  ApplyFrame(page_id, page_data);
 }
 template<int PagesPerFrame>
 void DiskManager<PagesPerFrame>::ReadFrame(page_id_t page_id, char *page_data) {
   ASSERT(page_id >= 0 && page_id < size_);
+  if (auto logged = log_ != nullptr ? log_->Find(log_file_id_, page_id) : nullptr; logged != nullptr) {
+    memcpy(page_data, logged, kFrameSize);
+    return;
+  }
+  if (backend_ == DiskBackend::MMAP) {
+    if (!Decode(page_id, FramePtr(page_id), page_data)) {
+      throw std::runtime_error("Checksum mismatch in frame " + std::to_string(page_id) + " of " + db_file_);
+    }
+    return;
+  }
   db_io_.seekg(toOffset(page_id));
   db_io_.read(page_data, kFrameSize);
+  DecodeFrame(page_id, page_data);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::WriteFrameAsync(page_id_t page_id, char *page_data, AsyncIO::tag_t tag) {
+  ASSERT(page_id >= 0 && page_id < size_);
+  SetChecksum(page_data);
+  async_->Write(toOffset(page_id), page_data, kFrameSize, tag);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::ReadFrameAsync(page_id_t page_id, char *page_data, AsyncIO::tag_t tag) {
+  ASSERT(page_id >= 0 && page_id < size_);
+  async_->Read(toOffset(page_id), page_data, kFrameSize, tag);
 }
 template<int PagesPerFrame>
 unsigned int DiskManager<PagesPerFrame>::AllocateFrame() {
   if (free_head == INVALID_PAGE_ID) {
+    if (backend_ == DiskBackend::MMAP) {
+      EnsureCapacity(size_ + 1);
+    }
     return size_ ++;
   }
-  int new_free_head = INVALID_PAGE_ID;
   int ret = free_head;
-  db_io_.seekg(toOffset(free_head));
-  db_io_.read(reinterpret_cast<char *>(&new_free_head), sizeof(int));
-  free_head = new_free_head;
+  // the link may be stored compressed, so the whole frame is read
+  link_buffer_.resize(kFrameSize);
+  ReadFrame(free_head, link_buffer_.data());
+  memcpy(&free_head, link_buffer_.data(), sizeof(int));
   return ret;
 }
 template<int PagesPerFrame>
@@ -91,16 +346,271 @@ void DiskManager<PagesPerFrame>::DeallocateFrame(page_id_t page_id) {
   ASSERT(page_id >= 0 && page_id < size_);
   int old_free_head = free_head;
   free_head = page_id;
-  db_io_.seekp(toOffset(page_id));
-  db_io_.write(reinterpret_cast<char *>(&old_free_head), sizeof(int));
+  // the whole frame is rewritten, so that its checksum covers the link
+  link_buffer_.resize(kFrameSize);
+  std::fill(link_buffer_.begin() + sizeof(int), link_buffer_.end(), 0);
+  memcpy(link_buffer_.data(), &old_free_head, sizeof(int));
+  SetChecksum(link_buffer_.data());
+  if (log_ != nullptr) {
+    // the link must not reach the file before the deletion commits
+    log_->Append(log_file_id_, page_id, link_buffer_.data());
+    return;
+  }
+  ApplyFrame(page_id, link_buffer_.data());
 }
 template<int PagesPerFrame>
 int &DiskManager<PagesPerFrame>::GetInfo(int index) {
-  ASSERT(index > 0 && index < kInfoSize);
+  ASSERT(index > 0 && index < kInfoSize - 1);
   return info_page_[index];
 }
 template<int PagesPerFrame>
-int DiskManager<PagesPerFrame>::toOffset(page_id_t page_id) {
-  return page_id * kFrameSize + sizeof(InfoPage);
+auto DiskManager<PagesPerFrame>::InfoData() -> const char * {
+  frame_count_ = size_;
+  return reinterpret_cast<const char *>(info_page_);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::ApplyFrame(page_id_t page_id, const char *data) {
+  SaveForSnapshot(page_id);
+  Store(page_id, data);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::Store(page_id_t page_id, const char *data) {
+  size_t size = compressed_ ? Encode(data) : kFrameSize;
+  const char *stored = size < kFrameSize ? codec_buffer_.data() : data;
+  if (backend_ == DiskBackend::MMAP) {
+    EnsureCapacity(page_id + 1); // a recovery may write frames that the file does not hold yet
+    memcpy(FramePtr(page_id), stored, size);
+  } else {
+    db_io_.seekp(toOffset(page_id));
+    db_io_.write(stored, size);
+    db_io_.flush(); // costs nothing extra, the buffered write would be flushed by the next seek anyway
+  }
+  if (size == kFrameSize) return;
+  // a file system that cannot punch holes keeps the old pages behind the code, which are never read
+  size_t begin = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+  fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, toOffset(page_id) + begin, kFrameSize - begin);
+  // the stream fails on a frame that the file does not hold whole
+  if (backend_ == DiskBackend::FSTREAM && lseek(fd_, 0, SEEK_END) < static_cast<off_t>(toOffset(page_id + 1))
+      && ftruncate(fd_, toOffset(page_id + 1)) != 0) {
+    throw std::runtime_error("Cannot resize file " + db_file_);
+  }
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::Encode(const char *data) -> size_t {
+  // only worth it if it saves a page
+  size_t capacity = kFrameSize - PAGE_SIZE - sizeof(CompressedHeader);
+  size_t size = CompressFrame(data, kFrameSize, codec_buffer_.data() + sizeof(CompressedHeader), capacity);
+  if (size == 0) return kFrameSize;
+  CompressedHeader header{kCompressedMagic, static_cast<uint32_t>(size)};
+  memcpy(codec_buffer_.data(), &header, sizeof(CompressedHeader));
+  return sizeof(CompressedHeader) + size;
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::LooksCompressed(const char *stored) -> bool {
+  if constexpr (!PAGE_CHECKSUM_ENABLED) return false;
+  CompressedHeader header;
+  memcpy(&header, stored, sizeof(CompressedHeader));
+  return header.magic == kCompressedMagic && header.size <= kFrameSize - sizeof(CompressedHeader);
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::Decode(page_id_t page_id, const char *stored, char *frame) -> bool {
+  if (LooksCompressed(stored)) {
+    uint32_t size;
+    memcpy(&size, stored + offsetof(CompressedHeader, size), sizeof(uint32_t));
+    if (DecompressFrame(stored + sizeof(CompressedHeader), size, frame, kFrameSize) && ChecksumValid(page_id, frame)) {
+      return true;
+    }
+    // else it may be a frame stored as is, which starts like a header by chance
+  }
+  memcpy(frame, stored, kFrameSize);
+  return ChecksumValid(page_id, frame);
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::DecodeInPlace(page_id_t page_id, char *frame) -> bool {
+  if (!LooksCompressed(frame)) return ChecksumValid(page_id, frame);
+  memcpy(codec_buffer_.data(), frame, kFrameSize);
+  return Decode(page_id, codec_buffer_.data(), frame);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::ApplyInfo(const char *info) {
+  if (info != reinterpret_cast<const char *>(info_page_)) {
+    memcpy(info_page_, info, sizeof(InfoPage));
+    size_ = frame_count_;
+  }
+  if (backend_ == DiskBackend::MMAP) {
+    EnsureCapacity(size_);
+    memcpy(map_, info_page_, sizeof(InfoPage));
+    return;
+  }
+  db_io_.seekp(0, std::ios::beg);
+  db_io_.write(reinterpret_cast<char *>(info_page_), sizeof(InfoPage));
+  db_io_.flush();
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::StartSync() {
+  // `SyncFile` waits for whatever is left; an error here is an error of the write-back all the same
+  if (sync_file_range(fd_, 0, 0, SYNC_FILE_RANGE_WRITE) != 0) {
+    throw std::runtime_error("Cannot sync file " + db_file_);
+  }
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::SyncFile() {
+  // fsync covers the frames written through the mapping as well; the stream is flushed after every write already
+  if (fsync(fd_) != 0) {
+    throw std::runtime_error("Cannot sync file " + db_file_);
+  }
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::BeginSnapshot(const std::string &file_name) {
+  if (snapshot_fd_ >= 0) close(snapshot_fd_);
+  snapshot_fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (snapshot_fd_ < 0) {
+    throw std::runtime_error("Cannot open file " + file_name);
+  }
+  frame_count_ = size_;
+  if (pwrite(snapshot_fd_, info_page_, sizeof(InfoPage), 0) != sizeof(InfoPage)
+      || ftruncate(snapshot_fd_, FileSize(size_)) != 0) {
+    throw std::runtime_error("Cannot write file " + file_name);
+  }
+  snapshot_size_ = size_;
+  snapshot_next_ = 0;
+  snapshot_copied_.assign(size_, false);
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::SnapshotStep(size_t size) -> bool {
+  if (snapshot_fd_ < 0) return true;
+  for (size_t copied = 0; copied < size && snapshot_next_ < snapshot_size_; ++snapshot_next_) {
+    if (snapshot_copied_[snapshot_next_]) continue;
+    CopyToSnapshot(snapshot_next_);
+    copied += kFrameSize;
+  }
+  if (snapshot_next_ < snapshot_size_) return false;
+  if (fsync(snapshot_fd_) != 0) {
+    throw std::runtime_error("Cannot sync the snapshot of " + db_file_);
+  }
+  close(snapshot_fd_);
+  snapshot_fd_ = -1;
+  snapshot_copied_ = {};
+  return true;
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::CopyToSnapshot(page_id_t page_id) {
+  const char *data;
+  std::vector<char> buffer;
+  if (backend_ == DiskBackend::MMAP) {
+    data = FramePtr(page_id);
+  } else {
+    buffer.resize(kFrameSize);
+    ReadFromFile(page_id, buffer.data());
+    data = buffer.data();
+  }
+  // the snapshot file starts as a hole, pages of zeros, e.g. those punched out behind a compressed frame, stay so
+  for (size_t page = 0; page < kFrameSize; page += PAGE_SIZE) {
+    if (std::all_of(data + page, data + page + PAGE_SIZE, [](char c) { return c == 0; })) continue;
+    if (pwrite(snapshot_fd_, data + page, PAGE_SIZE, toOffset(page_id) + page) != PAGE_SIZE) {
+      throw std::runtime_error("Cannot write the snapshot of " + db_file_);
+    }
+  }
+  snapshot_copied_[page_id] = true;
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::ReadFromFile(page_id_t page_id, char *data) {
+  ssize_t read = pread(fd_, data, kFrameSize, toOffset(page_id));
+  if (read < 0) {
+    throw std::runtime_error("Cannot read file " + db_file_);
+  }
+  memset(data + read, 0, kFrameSize - read); // a frame that was never written back reads short
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::ChecksumValid(page_id_t page_id, const char *data) const -> bool {
+  if constexpr (!PAGE_CHECKSUM_ENABLED) return true;
+  uint32_t crc;
+  memcpy(&crc, data + kChecksumOffset, sizeof(uint32_t));
+  if (crc == Crc32c(data, kChecksumOffset)) return true;
+  // the file is grown with zeros, which stay until the frame is first written; every frame below the committed
+  // count was written before the count was, so zeros there are a lost write
+  return page_id >= frame_count_ && crc == 0 && std::all_of(data, data + kChecksumOffset, [](char c) { return c == 0; });
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::DecodeFrame(page_id_t page_id, char *page_data) {
+  if (!DecodeInPlace(page_id, page_data)) {
+    throw std::runtime_error("Checksum mismatch in frame " + std::to_string(page_id) + " of " + db_file_);
+  }
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::ScrubStep(size_t size) -> std::vector<page_id_t> {
+  std::vector<page_id_t> corrupt;
+  if constexpr (!PAGE_CHECKSUM_ENABLED) return corrupt;
+  // the frames of the current group are not in the file yet, what the file holds of them is committed and checked
+  if (size_ == 0) return corrupt;
+  // steps smaller than a frame add up, so that large frames are not checked more often than `size` tells
+  for (scrub_credit_ += size; scrub_credit_ >= kFrameSize; scrub_credit_ -= kFrameSize) {
+    if (scrub_next_ >= size_) scrub_next_ = 0;
+    scrub_buffer_.resize(kFrameSize);
+    bool valid;
+    if (backend_ == DiskBackend::MMAP) {
+      valid = Decode(scrub_next_, FramePtr(scrub_next_), scrub_buffer_.data());
+    } else {
+      ReadFromFile(scrub_next_, scrub_buffer_.data());
+      valid = DecodeInPlace(scrub_next_, scrub_buffer_.data());
+    }
+    if (!valid) corrupt.push_back(scrub_next_);
+    ++scrub_next_;
+  }
+  return corrupt;
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::FramePtr(page_id_t page_id) -> char * {
+  ASSERT(backend_ == DiskBackend::MMAP);
+  ASSERT(page_id >= 0 && page_id < capacity_);
+  return map_ + toOffset(page_id);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::Prefetch(page_id_t page_id) {
+  if (backend_ != DiskBackend::MMAP || page_id < 0 || page_id >= size_) return;
+  // madvise needs a page-aligned address, which holds because the info page is exactly one page
+  madvise(FramePtr(page_id), kFrameSize, MADV_WILLNEED);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::Sync() {
+  if (backend_ != DiskBackend::MMAP) {
+    db_io_.flush();
+    return;
+  }
+  frame_count_ = size_;
+  memcpy(map_, info_page_, sizeof(InfoPage));
+  msync(map_, FileSize(size_), MS_SYNC);
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::WriteFrameConcurrent(page_id_t page_id, char *page_data) {
+  SetChecksum(page_data);
+  if (backend_ == DiskBackend::MMAP) {
+    // the mapping never moves, and growing the file does not touch frames that already exist
+    memcpy(map_ + toOffset(page_id), page_data, kFrameSize);
+    return;
+  }
+  size_t offset = toOffset(page_id), done = 0;
+  while (done < kFrameSize) {
+    ssize_t ret = pwrite(fd_, page_data + done, kFrameSize - done, offset + done);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) throw std::runtime_error("Cannot write file " + db_file_);
+    done += ret;
+  }
+}
+template<int PagesPerFrame>
+void DiskManager<PagesPerFrame>::EnsureCapacity(int frame_count) {
+  if (frame_count <= capacity_) return;
+  int new_capacity = std::max(frame_count, capacity_ + MMAP_GROW_FRAMES);
+  if (FileSize(new_capacity) > MMAP_RESERVE_SIZE) {
+    throw std::runtime_error("Database exceeds MMAP_RESERVE_SIZE");
+  }
+  if (ftruncate(fd_, FileSize(new_capacity)) != 0) {
+    throw std::runtime_error("Cannot resize file " + db_file_);
+  }
+  capacity_ = new_capacity;
+}
+template<int PagesPerFrame>
+auto DiskManager<PagesPerFrame>::toOffset(page_id_t page_id) -> size_t {
+  return static_cast<size_t>(page_id) * kFrameSize + sizeof(InfoPage);
 }
 } // namespace storage
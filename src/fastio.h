@@ -17,7 +17,24 @@ class FastIO {
   static auto Write(auto &&...a) { return ((WRITE(a)), ...); }
   static void WriteSuccess() { Write("0\n"); }
   static void WriteFailure() { Write("-1\n"); }
+  /// @brief Keep what is written back until `Release`, e.g. until the commands it answers are durable
+  static void Hold() { hold_ = true; }
+  /// @brief Write out what was kept back so far
+  static void Release() {
+    fwrite(held_.data(), 1, held_.size(), stdout);
+    fflush(stdout);
+    held_.clear();
+  }
  private:
+  static inline bool hold_ = false;
+  static inline std::string held_;
+  static void Put(char c) {
+    if (hold_) {
+      held_.push_back(c);
+    } else {
+      putchar(c);
+    }
+  }
   static void READ(std::integral auto &a) {
     int fl = 1;
     char c;
@@ -41,21 +58,21 @@ class FastIO {
     do s += c; while (std::isgraph(c = getchar()));
   }
   static void WRITE(char a) {
-    putchar(a);
+    Put(a);
   }
   static void WRITE(std::integral auto a) {
-    if (a < 0) putchar('-'), a = -a;
+    if (a < 0) Put('-'), a = -a;
     if (a > 9) WRITE(a / 10);
-    putchar(a % 10 + '0');
+    Put(a % 10 + '0');
   }
   static void WRITE(const char *s) {
-    while (*s) putchar(*s++);
+    while (*s) Put(*s++);
   }
   static void WRITE(const std::string &s) {
-    for (char c : s) putchar(c);
+    for (char c : s) Put(c);
   }
   static void WRITE(const std::string_view &s) {
-    for (char c : s) putchar(c);
+    for (char c : s) Put(c);
   }
 };
 
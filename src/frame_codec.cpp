@@ -0,0 +1,83 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#include "frame_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace storage {
+namespace {
+using word_t = uint32_t;
+using token_t = uint16_t;
+constexpr token_t kRunBit = 0x8000;
+constexpr size_t kMaxCount = kRunBit - 1; // words per token
+constexpr size_t kMinRun = 3; // a shorter run costs more as a token of its own than inside the literals
+
+auto WordAt(const char *data, size_t index) -> word_t {
+  word_t word;
+  memcpy(&word, data + index * sizeof(word_t), sizeof(word_t));
+  return word;
+}
+} // namespace
+
+auto CompressFrame(const char *data, size_t size, char *out, size_t capacity) -> size_t {
+  size_t words = size / sizeof(word_t), pos = 0;
+  // append the words [begin, end) as literals; @return false if they do not fit
+  auto put_literals = [&](size_t begin, size_t end) {
+    while (begin < end) {
+      size_t count = std::min(end - begin, kMaxCount);
+      if (pos + sizeof(token_t) + count * sizeof(word_t) > capacity) return false;
+      auto token = static_cast<token_t>(count);
+      memcpy(out + pos, &token, sizeof(token_t));
+      memcpy(out + pos + sizeof(token_t), data + begin * sizeof(word_t), count * sizeof(word_t));
+      pos += sizeof(token_t) + count * sizeof(word_t);
+      begin += count;
+    }
+    return true;
+  };
+  size_t literal_begin = 0;
+  for (size_t i = 0; i < words;) {
+    word_t word = WordAt(data, i);
+    size_t run = 1;
+    while (i + run < words && run < kMaxCount && WordAt(data, i + run) == word) ++run;
+    if (run < kMinRun) {
+      i += run;
+      continue;
+    }
+    if (!put_literals(literal_begin, i) || pos + sizeof(token_t) + sizeof(word_t) > capacity) return 0;
+    auto token = static_cast<token_t>(kRunBit | run);
+    memcpy(out + pos, &token, sizeof(token_t));
+    memcpy(out + pos + sizeof(token_t), &word, sizeof(word_t));
+    pos += sizeof(token_t) + sizeof(word_t);
+    i += run;
+    literal_begin = i;
+  }
+  if (!put_literals(literal_begin, words)) return 0;
+  return pos;
+}
+
+auto DecompressFrame(const char *code, size_t size, char *out, size_t frame_size) -> bool {
+  size_t pos = 0, out_pos = 0;
+  while (pos + sizeof(token_t) <= size) {
+    token_t token;
+    memcpy(&token, code + pos, sizeof(token_t));
+    pos += sizeof(token_t);
+    size_t count = token & ~kRunBit, bytes = count * sizeof(word_t);
+    if (out_pos + bytes > frame_size) return false;
+    if (token & kRunBit) {
+      if (pos + sizeof(word_t) > size) return false;
+      word_t word = WordAt(code + pos, 0);
+      pos += sizeof(word_t);
+      for (size_t i = 0; i < count; ++i) memcpy(out + out_pos + i * sizeof(word_t), &word, sizeof(word_t));
+    } else {
+      if (pos + bytes > size) return false;
+      memcpy(out + out_pos, code + pos, bytes);
+      pos += bytes;
+    }
+    out_pos += bytes;
+  }
+  return pos == size && out_pos == frame_size;
+}
+} // namespace storage
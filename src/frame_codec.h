@@ -0,0 +1,21 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace storage {
+/**
+ * @brief A run-length code over 4-byte words, for frames of ints: vacancy matrices are mostly long runs of equal seat
+ * counts, and unused space is runs of zeros. The code is a sequence of tokens of 2 bytes, whose top bit tells a run
+ * from literals and whose other bits count the words: a run token is followed by the word it repeats, a literal token
+ * by that many words. Runs shorter than `kMinRun` words stay in the literals.
+ * @return The size of the code of `size` bytes of `data` in `out`, 0 if it would not fit in `capacity` bytes
+ */
+auto CompressFrame(const char *data, size_t size, char *out, size_t capacity) -> size_t;
+/// @return Whether `size` bytes of code decompress to exactly `frame_size` bytes in `out`; a corrupt code is refused
+auto DecompressFrame(const char *code, size_t size, char *out, size_t frame_size) -> bool;
+} // namespace storage
@@ -0,0 +1,265 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "config.h"
+#include "utility.h"
+
+namespace storage {
+/**
+ * @brief Maps a key to a signed integer of the same order, so that frames of such keys can be searched with 64-bit
+ * vector compares. `Map` maps one key, `Load` the consecutive keys of a vector: 4 with AVX2, and with AVX-512 the 8
+ * lanes in `valid`, zero in the others. Keys of more than 8 bytes map to a 128-bit integer whose high and low halves
+ * take a lane each, see `kWide`: `Load` returns the high halves and stores the low ones to `*low`. Types without a
+ * mapping are searched with `upper_bound`.
+ */
+template<typename KeyType>
+struct OrderedKey {
+  static constexpr bool kSupported = false;
+};
+
+template<>
+struct OrderedKey<hash_t> {
+  static constexpr bool kSupported = true;
+  static constexpr bool kWide = false;
+  static auto Map(hash_t key) -> int64_t { return static_cast<int64_t>(key ^ (uint64_t{1} << 63)); }
+#ifdef __AVX2__
+  static auto Load(const hash_t *keys) -> __m256i {
+    auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+    return _mm256_xor_si256(block, _mm256_set1_epi64x(INT64_MIN));
+  }
+#endif
+#ifdef __AVX512F__
+  static auto Load(const hash_t *keys, __mmask8 valid) -> __m512i {
+    return _mm512_xor_si512(_mm512_maskz_loadu_epi64(valid, keys), _mm512_set1_epi64(INT64_MIN));
+  }
+#endif
+};
+
+/// <first, second> compares as the 64-bit integer with `first` in the high half, `second` is stored first though
+template<>
+struct OrderedKey<PackedPair<record_id_t, record_id_t> > {
+  static constexpr bool kSupported = true;
+  static constexpr bool kWide = false;
+  static auto Map(const PackedPair<record_id_t, record_id_t> &key) -> int64_t {
+    return static_cast<int64_t>(static_cast<uint64_t>(static_cast<uint32_t>(key.first)) << 32
+                                | (static_cast<uint32_t>(key.second) ^ 0x80000000u));
+  }
+#ifdef __AVX2__
+  static auto Load(const PackedPair<record_id_t, record_id_t> *keys) -> __m256i {
+    auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+    return _mm256_xor_si256(_mm256_shuffle_epi32(block, 0xB1), _mm256_set1_epi64x(0x80000000));
+  }
+#endif
+#ifdef __AVX512F__
+  static auto Load(const PackedPair<record_id_t, record_id_t> *keys, __mmask8 valid) -> __m512i {
+    // the zero-masking form, the plain shuffle leaves its pass-through source undefined
+    auto block = _mm512_maskz_shuffle_epi32(0xFFFF, _mm512_maskz_loadu_epi64(valid, keys), _MM_PERM_CDAB);
+    return _mm512_xor_si512(block, _mm512_set1_epi64(0x80000000));
+  }
+#endif
+};
+
+/**
+ * <first, second> of 6 bytes, <user, order> of the ticket index: `first` in the high half, `second` below it. The
+ * keys are not lane-aligned, so a vector gathers the 4 bytes of `first` and the 4 bytes that end in `second`; no
+ * byte outside the keys is read.
+ */
+template<>
+struct OrderedKey<PackedPair<record_id_t, int16_t> > {
+  using Key = PackedPair<record_id_t, int16_t>;
+  static constexpr bool kSupported = true;
+  static constexpr bool kWide = false;
+  static auto Map(const Key &key) -> int64_t {
+    return static_cast<int64_t>(static_cast<uint64_t>(static_cast<uint32_t>(key.first)) << 32
+                                | (static_cast<uint16_t>(key.second) ^ 0x8000u));
+  }
+#ifdef __AVX2__
+  static auto Load(const Key *keys) -> __m256i {
+    auto base = reinterpret_cast<const int *>(keys);
+    auto offsets = _mm_setr_epi32(0, sizeof(Key), 2 * sizeof(Key), 3 * sizeof(Key));
+    auto first = _mm256_cvtepu32_epi64(_mm_i32gather_epi32(base, offsets, 1));
+    auto second = _mm256_cvtepu32_epi64(_mm_i32gather_epi32(base, _mm_add_epi32(offsets, _mm_set1_epi32(2)), 1));
+    return _mm256_or_si256(_mm256_slli_epi64(first, 32),
+                           _mm256_xor_si256(_mm256_srli_epi64(second, 16), _mm256_set1_epi64x(0x8000)));
+  }
+#endif
+#ifdef __AVX512F__
+  static auto Load(const Key *keys, __mmask8 valid) -> __m512i {
+    auto base = reinterpret_cast<const int *>(keys);
+    auto offsets = _mm512_setr_epi64(0, 6, 12, 18, 24, 30, 36, 42);
+    auto gather = [&](int shift) {
+      auto indices = _mm512_add_epi64(offsets, _mm512_set1_epi64(shift));
+      return _mm512_maskz_cvtepu32_epi64(valid, _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), valid, indices,
+                                                                             base, 1));
+    };
+    auto second = _mm512_maskz_srli_epi64(valid, gather(2), 16);
+    return _mm512_or_si512(_mm512_maskz_slli_epi64(valid, gather(0), 32),
+                           _mm512_xor_si512(second, _mm512_set1_epi64(0x8000)));
+  }
+#endif
+};
+
+/**
+ * <<first, date>, second> of 9 bytes, <<train, date>, timestamp> of the pending queue: <first, date> in the high
+ * half of a 128-bit integer, `second` in the low one. As above, a vector gathers `first`, the 4 bytes that end in
+ * the date, and `second`.
+ */
+template<>
+struct OrderedKey<PackedPair<PackedPair<record_id_t, int8_t>, int> > {
+  using Key = PackedPair<PackedPair<record_id_t, int8_t>, int>;
+  static constexpr bool kSupported = true;
+  static constexpr bool kWide = true;
+  static auto Map(const Key &key) -> __int128 {
+    auto high = static_cast<int64_t>(key.first.first) << 8 | (static_cast<uint8_t>(key.first.second) ^ 0x80u);
+    return static_cast<__int128>(high) << 32 | (static_cast<uint32_t>(key.second) ^ 0x80000000u);
+  }
+#ifdef __AVX2__
+  static auto Load(const Key *keys, __m256i *low) -> __m256i {
+    auto base = reinterpret_cast<const int *>(keys);
+    auto offsets = _mm_setr_epi32(0, sizeof(Key), 2 * sizeof(Key), 3 * sizeof(Key));
+    auto gather = [&](int shift) {
+      return _mm_i32gather_epi32(base, _mm_add_epi32(offsets, _mm_set1_epi32(shift)), 1);
+    };
+    auto first = _mm256_cvtepi32_epi64(gather(0));
+    auto date = _mm256_srli_epi64(_mm256_cvtepu32_epi64(gather(1)), 24);
+    auto high = _mm256_or_si256(_mm256_slli_epi64(first, 8), _mm256_xor_si256(date, _mm256_set1_epi64x(0x80)));
+    *low = _mm256_cvtepi32_epi64(gather(5));
+    return high;
+  }
+#endif
+#ifdef __AVX512F__
+  static auto Load(const Key *keys, __mmask8 valid, __m512i *low) -> __m512i {
+    auto base = reinterpret_cast<const int *>(keys);
+    auto offsets = _mm512_setr_epi64(0, 9, 18, 27, 36, 45, 54, 63);
+    auto gather = [&](int shift) {
+      auto indices = _mm512_add_epi64(offsets, _mm512_set1_epi64(shift));
+      return _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), valid, indices, base, 1);
+    };
+    auto first = _mm512_maskz_cvtepi32_epi64(valid, gather(0));
+    auto date = _mm512_maskz_srli_epi64(valid, _mm512_maskz_cvtepu32_epi64(valid, gather(1)), 24);
+    auto high = _mm512_or_si512(_mm512_maskz_slli_epi64(valid, first, 8),
+                                _mm512_xor_si512(date, _mm512_set1_epi64(0x80)));
+    *low = _mm512_maskz_cvtepi32_epi64(valid, gather(5));
+    return high;
+  }
+#endif
+};
+
+/**
+ * @brief Search kernels for the sorted keys of a frame. Each returns the rank of `key` in `keys[0, size)`: the
+ * number of keys not above it. `KeyRank` picks one by `BPT_KEY_SEARCH`; the others are public for benchmarking.
+ */
+namespace key_search {
+static constexpr int kSimdBlock = 16; // binary search narrows the range down to this many keys
+static constexpr int kInterpolationWindow = 16; // keys counted around the interpolated position
+
+template<typename KeyType>
+auto RankBinary(const KeyType *keys, int size, const KeyType &key) -> int {
+  return static_cast<int>(upper_bound(keys, keys + size, key) - keys);
+}
+
+/// @brief Rank of `key` in `keys[0, size)` by comparing against every key, at most `kSimdBlock` of them
+template<typename KeyType>
+auto CountNotAbove(const KeyType *keys, int size, const KeyType &key) -> int {
+  using Ordered = OrderedKey<KeyType>;
+  auto target_key = Ordered::Map(key);
+  int count = 0;
+  int i = 0;
+#if defined(__AVX512F__)
+  // the wide keys are above if their high half is, or if it is equal and their low half is; the low halves are
+  // compared as the signed `second`, which orders them as the offset ones of `Map`
+  auto target_high = _mm512_set1_epi64(static_cast<int64_t>(target_key >> (Ordered::kWide ? 32 : 0)));
+  auto target_low = _mm512_set1_epi64(static_cast<int32_t>(static_cast<uint32_t>(target_key) ^ 0x80000000u));
+  for (; i < size; i += 8) {
+    __mmask8 valid = size - i >= 8 ? 0xFF : static_cast<__mmask8>((1u << (size - i)) - 1);
+    __mmask8 above;
+    if constexpr (Ordered::kWide) {
+      __m512i low;
+      auto high = Ordered::Load(keys + i, valid, &low);
+      above = _mm512_mask_cmpgt_epi64_mask(valid, high, target_high)
+              | _mm512_mask_cmpgt_epi64_mask(_mm512_mask_cmpeq_epi64_mask(valid, high, target_high), low, target_low);
+    } else {
+      above = _mm512_mask_cmpgt_epi64_mask(valid, Ordered::Load(keys + i, valid), target_high);
+    }
+    count += std::popcount(static_cast<unsigned>(valid)) - std::popcount(static_cast<unsigned>(above));
+  }
+#elif defined(__AVX2__)
+  auto target_high = _mm256_set1_epi64x(static_cast<int64_t>(target_key >> (Ordered::kWide ? 32 : 0)));
+  auto target_low = _mm256_set1_epi64x(static_cast<int32_t>(static_cast<uint32_t>(target_key) ^ 0x80000000u));
+  for (; i + 4 <= size; i += 4) {
+    __m256i above;
+    if constexpr (Ordered::kWide) {
+      __m256i low;
+      auto high = Ordered::Load(keys + i, &low);
+      above = _mm256_or_si256(_mm256_cmpgt_epi64(high, target_high),
+                              _mm256_and_si256(_mm256_cmpeq_epi64(high, target_high),
+                                               _mm256_cmpgt_epi64(low, target_low)));
+    } else {
+      above = _mm256_cmpgt_epi64(Ordered::Load(keys + i), target_high);
+    }
+    count += 4 - std::popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(above))));
+  }
+#endif
+  for (; i < size; ++i) {
+    count += Ordered::Map(keys[i]) <= target_key;
+  }
+  return count;
+}
+
+/// @brief Branchless binary search down to `kSimdBlock` keys, which are then counted by `CountNotAbove`
+template<typename KeyType>
+auto RankSimd(const KeyType *keys, int size, const KeyType &key) -> int {
+  using Ordered = OrderedKey<KeyType>;
+  auto target = Ordered::Map(key);
+  const KeyType *base = keys;
+  int count = size;
+  while (count > kSimdBlock) {
+    int half = count / 2;
+    base = Ordered::Map(base[half]) <= target ? base + half : base;
+    count -= half;
+  }
+  return static_cast<int>(base - keys) + CountNotAbove(base, count, key);
+}
+
+/**
+ * @brief Hashes are spread uniformly over their range, so the rank is close to the one the key range predicts.
+ * Counts the window around that guess if it holds the rank, and falls back to `RankSimd` otherwise.
+ */
+inline auto RankInterpolation(const hash_t *keys, int size, hash_t key) -> int {
+  if (size <= kInterpolationWindow) return CountNotAbove(keys, size, key);
+  if (key < keys[0]) return 0;
+  if (key >= keys[size - 1]) return size;
+  auto guess = static_cast<int>(static_cast<double>(key - keys[0]) / static_cast<double>(keys[size - 1] - keys[0])
+                                * (size - 1));
+  int start = std::clamp(guess - kInterpolationWindow / 2, 0, size - kInterpolationWindow);
+  int end = start + kInterpolationWindow;
+  if ((start == 0 || keys[start - 1] <= key) && (end == size || key < keys[end])) {
+    return start + CountNotAbove(keys + start, kInterpolationWindow, key);
+  }
+  return RankSimd(keys, size, key);
+}
+} // namespace key_search
+
+/// @brief Rank of `key` in the sorted `keys[0, size)`, with the kernel `BPT_KEY_SEARCH` selects for the key type
+template<typename KeyType>
+auto KeyRank(const KeyType *keys, int size, const KeyType &key) -> int {
+  if constexpr (BPT_KEY_SEARCH == KeySearch::INTERPOLATION && std::is_same_v<KeyType, hash_t>) {
+    return key_search::RankInterpolation(keys, size, key);
+  } else if constexpr (BPT_KEY_SEARCH != KeySearch::BINARY && OrderedKey<KeyType>::kSupported) {
+    return key_search::RankSimd(keys, size, key);
+  } else {
+    return key_search::RankBinary(keys, size, key);
+  }
+}
+} // namespace storage
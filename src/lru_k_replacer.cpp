@@ -4,56 +4,108 @@
 
 #include "lru_k_replacer.h"
 
+#include <algorithm>
+#include <bit>
+
 namespace storage {
-LRUKReplacer::LRUKReplacer(size_t pool_size) {
-  evict_hint_.resize(pool_size, evitable_frames_.end());
+LRUKReplacer::LRUKReplacer(size_t pool_size) : pool_size_(static_cast<frame_id_t>(pool_size)),
+                                               epoch_width_(std::max<timestamp_t>(pool_size, 1)),
+                                               nodes_(pool_size), links_(pool_size + kBuckets + 1) {
+  for (int list = 0; list <= kInfantList; ++list) {
+    links_[Head(list)] = {Head(list), Head(list)};
+  }
 }
 auto LRUKReplacer::Evict(frame_id_t *frame_id) -> bool {
-  if (evitable_frames_.empty()) {
+  if (size_ == 0) {
     return false;
   }
-  auto it = evitable_frames_.begin();
-  *frame_id = it->second;
-  evict_hint_[it->second] = evitable_frames_.end();
-  evitable_frames_.erase(it);
+  int list = kInfantList;
+  if (links_[Head(kInfantList)].next == Head(kInfantList)) {
+    // the oldest bucket in the ring is the one after the current epoch's
+    int oldest = static_cast<int>((epoch_ + 1) % kBuckets);
+    list = (oldest + std::countr_zero(std::rotr(non_empty_, oldest))) % kBuckets;
+  }
+  *frame_id = links_[Head(list)].next;
+  Unlink(*frame_id);
+  nodes_[*frame_id] = Node{};
   return true;
 }
-auto LRUKReplacer::RecordAccess(page_id_t page_id) -> void {
-  auto &node = access_history_[page_id];
-  node.RecordAccess();
+auto LRUKReplacer::RecordAccess(frame_id_t frame_id, page_id_t) -> void {
+  auto &node = nodes_[frame_id];
+  bool evictable = node.evictable;
+  if (evictable) Unlink(frame_id);
+  if (++timestamp_ / epoch_width_ != epoch_) AdvanceEpoch();
+  node.history[node.tail] = timestamp_;
+  node.tail = (node.tail + 1) % replacer_k;
+  if (node.count < replacer_k) ++node.count;
+  if (evictable) Link(frame_id);
 }
-void LRUKReplacer::SetEvictable(frame_id_t frame_id, page_id_t page_id) {
-  if (evict_hint_[frame_id] != evitable_frames_.end()) {
-    evitable_frames_.erase(evict_hint_[frame_id]);
-  }
-  evict_hint_[frame_id] = evitable_frames_.emplace(GetKDistance(page_id), frame_id).first;
+void LRUKReplacer::SetEvictable(frame_id_t frame_id) {
+  if (!nodes_[frame_id].evictable) Link(frame_id);
 }
 void LRUKReplacer::SetNonevictable(frame_id_t frame_id) {
-  if (evict_hint_[frame_id] != evitable_frames_.end()) {
-    evitable_frames_.erase(evict_hint_[frame_id]);
-    evict_hint_[frame_id] = evitable_frames_.end();
-  }
+  if (nodes_[frame_id].evictable) Unlink(frame_id);
 }
-void LRUKReplacer::Remove(frame_id_t frame_id, page_id_t page_id) {
-  if (evict_hint_[frame_id] != evitable_frames_.end()) {
-    evitable_frames_.erase(evict_hint_[frame_id]);
-    evict_hint_[frame_id] = evitable_frames_.end();
-  }
-  access_history_.erase(page_id);
+void LRUKReplacer::Remove(frame_id_t frame_id) {
+  SetNonevictable(frame_id);
+  nodes_[frame_id] = Node{};
 }
 auto LRUKReplacer::Size() const -> size_t {
-  return evitable_frames_.size();
+  return size_;
+}
+void LRUKReplacer::Coldest(size_t n, std::vector<frame_id_t> *frames) const {
+  auto collect = [&](int list) {
+    for (frame_id_t it = links_[Head(list)].next; it != Head(list) && n > 0; it = links_[it].next, --n) {
+      frames->push_back(it);
+    }
+  };
+  collect(kInfantList);
+  for (int i = 1; i <= kBuckets && n > 0; ++i) {
+    collect(static_cast<int>((epoch_ + i) % kBuckets));
+  }
 }
-auto LRUKReplacer::GetKDistance(page_id_t page_id) -> time_distance_t {
-  auto &node = access_history_[page_id];
-  return node.GetKDistance();
+auto LRUKReplacer::ListOf(const Node &node) const -> int {
+  if (node.count < replacer_k) return kInfantList;
+  timestamp_t epoch = node.history[node.tail] / epoch_width_;
+  // buckets older than the ring have been merged into the oldest one
+  if (epoch + kBuckets <= epoch_) epoch = epoch_ - kBuckets + 1;
+  return static_cast<int>(epoch % kBuckets);
 }
-void LRUKReplacer::LRUKNode::RecordAccess() {
-  ++timestamp_;
-  queue[tail] = timestamp_;
-  tail = (tail + 1) % replacer_k;
+void LRUKReplacer::Link(frame_id_t frame_id) {
+  auto &node = nodes_[frame_id];
+  int list = ListOf(node);
+  frame_id_t head = Head(list), last = links_[head].prev;
+  links_[frame_id] = {last, head};
+  links_[last].next = frame_id;
+  links_[head].prev = frame_id;
+  if (list != kInfantList) non_empty_ |= uint64_t(1) << list;
+  node.evictable = true;
+  ++size_;
+}
+void LRUKReplacer::Unlink(frame_id_t frame_id) {
+  auto &node = nodes_[frame_id];
+  auto [prev, next] = links_[frame_id];
+  links_[prev].next = next;
+  links_[next].prev = prev;
+  if (prev == next && prev >= pool_size_ && prev != Head(kInfantList)) {
+    non_empty_ &= ~(uint64_t(1) << (prev - pool_size_));
+  }
+  node.evictable = false;
+  --size_;
 }
-auto LRUKReplacer::LRUKNode::GetKDistance() -> time_distance_t {
-  return {queue[tail], queue[(tail + replacer_k - 1) % replacer_k]};
+void LRUKReplacer::AdvanceEpoch() {
+  ++epoch_;
+  // the new epoch reuses the bucket of the one that just left the ring: move its frames to the front of the oldest
+  int expired = static_cast<int>(epoch_ % kBuckets), oldest = static_cast<int>((epoch_ + 1) % kBuckets);
+  frame_id_t from = Head(expired), to = Head(oldest);
+  if (links_[from].next == from) return;
+  frame_id_t first = links_[from].next, last = links_[from].prev, old_first = links_[to].next;
+  links_[to].next = first;
+  links_[first].prev = to;
+  links_[last].next = old_first;
+  links_[old_first].prev = last;
+  links_[from] = {from, from};
+  non_empty_ &= ~(uint64_t(1) << expired);
+  non_empty_ |= uint64_t(1) << oldest;
 }
 } // namespace storage
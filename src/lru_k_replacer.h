@@ -5,47 +5,71 @@
 #pragma once
 #include <config.h>
 #include <cstdint>
-#include <map>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 namespace storage {
+/**
+ * @brief LRU-K replacement with constant-time operations.
+ *
+ * The access history is kept per frame, so its memory is bounded by the pool size; a frame forgets its history
+ * when it is evicted or removed. Only evictable frames are linked into one of the intrusive lists:
+ * - the infant list, frames with fewer than K accesses. They have an infinite K-distance and go first.
+ * - a ring of `kBuckets` epoch buckets, frames grouped by the epoch of their K-th most recent access.
+ *   An epoch is `pool_size` accesses long; frames older than the ring are merged into its oldest bucket.
+ * A bitmap of the non-empty buckets finds the oldest one without scanning.
+ * A frame is appended to its list whenever it is linked, that is when it becomes evictable or is accessed while
+ * evictable, and each list is first in, first out. So only the buckets follow the K-distance, at epoch granularity:
+ * within a bucket, and within the infant list, the victim is the frame that was unpinned longest ago, as in plain LRU.
+ */
 class LRUKReplacer {
   public:
     using frame_id_t = int;
-    using timestamp_t = uint32_t;
-    using time_distance_t = std::pair<timestamp_t, timestamp_t>;
+    using timestamp_t = uint64_t;
     explicit LRUKReplacer(size_t pool_size);
 
-    /// Will not clear the access history
+    /// Clears the access history of the victim
     auto Evict(frame_id_t *frame_id) -> bool;
 
-    auto RecordAccess(page_id_t page_id) -> void;
+    auto RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void;
 
-    void SetEvictable(frame_id_t frame_id, page_id_t page_id);
+    void SetEvictable(frame_id_t frame_id);
 
     void SetNonevictable(frame_id_t frame_id);
 
-    void Remove(frame_id_t frame_id, page_id_t page_id);
+    /// @brief Forget the frame and its access history
+    void Remove(frame_id_t frame_id);
 
     auto Size() const -> size_t;
 
+    /// @brief Append up to `n` evictable frames, the next victim first
+    void Coldest(size_t n, std::vector<frame_id_t> *frames) const;
+
   private:
     static constexpr int replacer_k = LRU_REPLACER_K;
-    inline static timestamp_t timestamp_ = 0;
-    auto GetKDistance(page_id_t page_id) -> time_distance_t;
-    class LRUKNode {
-      public:
-        void RecordAccess();
-        auto GetKDistance() -> time_distance_t;
-
-      private:
-        timestamp_t queue[replacer_k] = {};
-        int tail = 0;
+    static constexpr int kBuckets = 64; // one bit each in `non_empty_`
+    static constexpr int kInfantList = kBuckets;
+    struct Node {
+      timestamp_t history[replacer_k] = {}; // ring buffer, `history[tail]` is the K-th most recent access once full
+      uint8_t tail = 0;
+      uint8_t count = 0; // number of recorded accesses, saturates at K
+      bool evictable = false; // whether the frame is linked into a list
+    };
+    struct Link {
+      frame_id_t prev, next;
     };
-    std::unordered_map<page_id_t, LRUKNode> access_history_; // the Key is page_id because the history is page-based
-    std::map<time_distance_t, frame_id_t> evitable_frames_;
-    std::vector<decltype(evitable_frames_)::iterator> evict_hint_;
+    const frame_id_t pool_size_;
+    const timestamp_t epoch_width_;
+    timestamp_t timestamp_ = 0;
+    timestamp_t epoch_ = 0; // epoch of `timestamp_`
+    uint64_t non_empty_ = 0; // bit i: bucket i is not empty
+    size_t size_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<Link> links_; // frames first, then the list heads: bucket 0 .. kBuckets - 1, the infant list
+
+    auto Head(int list) const -> frame_id_t { return pool_size_ + list; }
+    auto ListOf(const Node &node) const -> int;
+    void Link(frame_id_t frame_id);
+    void Unlink(frame_id_t frame_id);
+    void AdvanceEpoch();
 };
 } // namespace storage
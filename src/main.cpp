@@ -7,8 +7,11 @@
 #include "buffer_pool_manager.h"
 #include "b_plus_tree.h"
 #include "config.h"
+#include <chrono>
 #include <iostream>
 #include <parser.h>
+#include <random>
+#include <set>
 
 #include "fastio.h"
 #include "hash.h"
@@ -153,6 +156,149 @@ void pair_test() {
   std::cout << "Size of PackedPair: " << sizeof(storage::PackedPair<storage::hash_t, int>) << std::endl; // 12
 }
 
+/**
+ * Nanoseconds per search of each `key_search` kernel against the `upper_bound` that KeyIndex used before, on
+ * frames filled to capacity with sorted random keys, for the frame sizes of 1, 2 and 4 pages.
+ */
+template<typename KeyType, int PagesPerFrame>
+void key_search_bench_frame(const char *name, auto make_key) {
+  using internal_frame = storage::BPlusTreeInternalFrame<KeyType, storage::page_id_t, PagesPerFrame>;
+  static constexpr int kSearches = 1 << 22;
+  std::mt19937_64 rng(PagesPerFrame);
+  int size = internal_frame::GetMaxSize();
+  std::vector<KeyType> keys(size);
+  for (auto &key : keys) key = make_key(rng);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  size = static_cast<int>(keys.size());
+  std::vector<KeyType> queries(1 << 12);
+  for (auto &query : queries) query = make_key(rng);
+  auto time = [&](auto search) {
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kSearches; ++i) {
+      checksum += search(keys.data(), size, queries[i & (queries.size() - 1)]);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << ' ' << elapsed.count() / kSearches << "ns";
+    return checksum;
+  };
+  std::cout << name << ", " << PagesPerFrame << " page(s), " << size << " keys:";
+  auto expected = time([](auto *k, int n, const KeyType &key) { return storage::key_search::RankBinary(k, n, key); });
+  bool same = true;
+  if constexpr (storage::OrderedKey<KeyType>::kSupported) {
+    same &= time([](auto *k, int n, const KeyType &key) { return storage::key_search::RankSimd(k, n, key); }) == expected;
+  }
+  if constexpr (std::is_same_v<KeyType, storage::hash_t>) {
+    same &= time([](auto *k, int n, storage::hash_t key) {
+      return storage::key_search::RankInterpolation(k, n, key);
+    }) == expected;
+  }
+  std::cout << (same ? "" : " MISMATCH") << std::endl;
+}
+
+void key_search_bench() {
+  // binary / SIMD / interpolation
+  auto hash_key = [](std::mt19937_64 &rng) { return static_cast<storage::hash_t>(rng()); };
+  auto pair_key = [](std::mt19937_64 &rng) {
+    return storage::make_packed_pair(static_cast<storage::record_id_t>(rng() % 20000),
+                                     static_cast<storage::record_id_t>(rng() % 10000));
+  };
+  key_search_bench_frame<storage::hash_t, 1>("hash_t", hash_key);
+  key_search_bench_frame<storage::hash_t, 2>("hash_t", hash_key);
+  key_search_bench_frame<storage::hash_t, 4>("hash_t", hash_key);
+  key_search_bench_frame<storage::PackedPair<storage::record_id_t, storage::record_id_t>, 1>("<station, train>", pair_key);
+  key_search_bench_frame<storage::PackedPair<storage::record_id_t, storage::record_id_t>, 2>("<station, train>", pair_key);
+  key_search_bench_frame<storage::PackedPair<storage::record_id_t, storage::record_id_t>, 4>("<station, train>", pair_key);
+  using order_key = storage::PackedPair<storage::record_id_t, business::order_no_t>;
+  auto order_key_of = [](std::mt19937_64 &rng) {
+    return storage::make_packed_pair(static_cast<storage::record_id_t>(rng() % 20000),
+                                     static_cast<business::order_no_t>(-static_cast<int>(rng() % 30000)));
+  };
+  key_search_bench_frame<order_key, 1>("<user, order>", order_key_of);
+  key_search_bench_frame<order_key, 2>("<user, order>", order_key_of);
+  key_search_bench_frame<order_key, 4>("<user, order>", order_key_of);
+  using pending_key = storage::PackedPair<storage::PackedPair<storage::record_id_t, business::date_t>, int>;
+  auto pending_key_of = [](std::mt19937_64 &rng) {
+    return storage::make_packed_pair(storage::make_packed_pair(static_cast<storage::record_id_t>(rng() % 2000),
+                                                               static_cast<business::date_t>(rng() % 92)),
+                                     static_cast<int>(rng() % 100000000));
+  };
+  key_search_bench_frame<pending_key, 1>("<<train, date>, timestamp>", pending_key_of);
+  key_search_bench_frame<pending_key, 2>("<<train, date>, timestamp>", pending_key_of);
+  key_search_bench_frame<pending_key, 4>("<<train, date>, timestamp>", pending_key_of);
+}
+
+/**
+ * Nanoseconds per `UpperIndex` of the internal frame layouts, over full frames of sorted random hash_t keys:
+ * 256 frames fit in the last level cache, 16384 do not, as in a descent through resident pages of a large tree.
+ */
+template<storage::InternalLayout Layout>
+void internal_layout_bench_frames(const char *name, int frames) {
+  using internal_frame = storage::BPlusTreeInternalFrame<storage::hash_t, storage::page_id_t, 1, Layout>;
+  static constexpr int kSearches = 1 << 22;
+  constexpr int frame_size = storage::Frame<1>::kFrameSize;
+  std::mt19937_64 rng(1);
+  size_t frames_size = static_cast<size_t>(frames) * frame_size, buffer_size = frames_size + storage::CACHE_LINE_SIZE;
+  auto arena = std::make_unique<char[]>(buffer_size);
+  void *aligned = arena.get(); // as the buffer pool aligns its frames
+  auto buffer = static_cast<char *>(std::align(storage::CACHE_LINE_SIZE, frames_size, aligned, buffer_size));
+  std::vector<storage::hash_t> keys(internal_frame::GetMaxSize());
+  for (int i = 0; i < frames; ++i) {
+    auto frame = reinterpret_cast<internal_frame *>(buffer + static_cast<size_t>(i) * frame_size);
+    for (auto &key : keys) key = rng();
+    std::sort(keys.begin(), keys.end());
+    frame->Init();
+    for (size_t j = 0; j < keys.size(); ++j) frame->SetKeyAt(j + 1, keys[j]);
+    frame->SetSize(keys.size());
+    frame->Reindex();
+  }
+  long long checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kSearches; ++i) {
+    auto frame = reinterpret_cast<const internal_frame *>(buffer + rng() % frames * frame_size);
+    checksum += frame->UpperIndex(rng());
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << name << ", " << frames << " frames of " << internal_frame::GetMaxSize() << " keys: "
+            << elapsed.count() / kSearches << "ns (checksum " << checksum << ")" << std::endl;
+}
+
+void internal_layout_bench() {
+  for (int frames : {1 << 8, 1 << 14}) {
+    internal_layout_bench_frames<storage::InternalLayout::SORTED>("sorted", frames);
+    internal_layout_bench_frames<storage::InternalLayout::BLOCKED>("blocked", frames);
+  }
+}
+
+/**
+ * Entries per leaf of a <station, train> tree built by inserts, 15 stops for each of 10000 trains over 3000 stations,
+ * with `BPT_PACKED_LEAVES` on a leaf stores every station once for all of its trains.
+ */
+void packed_leaf_bench() {
+  using key_type = storage::PackedPair<storage::record_id_t, storage::record_id_t>;
+  storage::BufferPoolManager<storage::BPT_PAGES_PER_FRAME> bpm("bench.db", true);
+  storage::page_id_t root_page_id = storage::INVALID_PAGE_ID;
+  storage::BPlusTree<key_type, storage::NoValue> bpt(&bpm, root_page_id, true);
+  std::mt19937 rng(1);
+  std::vector<key_type> keys;
+  for (int train = 0; train < 10000; ++train) {
+    for (int stop = 0; stop < 15; ++stop) {
+      key_type key = storage::make_packed_pair(static_cast<storage::record_id_t>(rng() % 3000), train);
+      if (bpt.Insert(key, {})) keys.push_back(key);
+    }
+  }
+  std::set<storage::page_id_t> leaves;
+  for (const auto &key : keys) leaves.insert(bpt.GetValue(key).PageId());
+  auto start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (storage::record_id_t station = 0; station < 3000; ++station) found += bpt.PartialSearch(station).size();
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << keys.size() << " entries in " << leaves.size() << " leaves, "
+            << static_cast<double>(keys.size()) / leaves.size() << " entries per leaf; PartialSearch of every station: "
+            << elapsed.count() << "us (" << found << " found)" << std::endl;
+}
+
 void parser_test() {
   std::string input = "[1623456789] command -a こんにちは -b value2";
   try {
@@ -169,6 +315,12 @@ void parser_test() {
 int main() {
   // bpt_test();
   // storage_test(true);
+#ifdef BENCH
+  key_search_bench();
+  internal_layout_bench();
+  packed_leaf_bench();
+  return 0;
+#endif
   bool force_reset = false;
   business::TicketSystemCLI cli(force_reset);
   cli.run();
@@ -0,0 +1,53 @@
+//
+// Created by zj on 6/5/2024.
+//
+
+#include "page_table.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace storage {
+PageTable::PageTable(size_t pool_size) {
+  size_t capacity = std::bit_ceil(std::max<size_t>(pool_size * 2, 2));
+  slots_.resize(capacity);
+  mask_ = capacity - 1;
+  shift_ = 64 - std::countr_zero(capacity);
+}
+void PageTable::Insert(page_id_t page_id, frame_id_t frame_id) {
+  Slot entry{page_id, frame_id};
+  for (size_t i = Home(page_id), dist = 0;; i = (i + 1) & mask_, ++dist) {
+    Slot &slot = slots_[i];
+    if (slot.page_id == INVALID_PAGE_ID) {
+      slot = entry;
+      return;
+    }
+    if (slot.page_id == entry.page_id) {
+      slot.frame_id = entry.frame_id;
+      return;
+    }
+    // robin hood: the entry further from its home takes the slot, the other one moves on
+    if (size_t slot_dist = Distance(slot.page_id, i); slot_dist < dist) {
+      std::swap(slot, entry);
+      dist = slot_dist;
+    }
+  }
+}
+void PageTable::Erase(page_id_t page_id) {
+  size_t i = Home(page_id);
+  for (size_t dist = 0;; i = (i + 1) & mask_, ++dist) {
+    const Slot &slot = slots_[i];
+    if (slot.page_id == page_id) break;
+    if (slot.page_id == INVALID_PAGE_ID || Distance(slot.page_id, i) < dist) return;
+  }
+  // shift the following entries back until one is empty or already at its home
+  for (size_t next = (i + 1) & mask_;; i = next, next = (next + 1) & mask_) {
+    if (slots_[next].page_id == INVALID_PAGE_ID || Distance(slots_[next].page_id, next) == 0) {
+      slots_[i] = Slot{};
+      return;
+    }
+    slots_[i] = slots_[next];
+  }
+}
+} // namespace storage
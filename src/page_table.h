@@ -0,0 +1,52 @@
+//
+// Created by zj on 6/5/2024.
+//
+
+#pragma once
+#include <config.h>
+#include <cstdint>
+#include <vector>
+
+namespace storage {
+/**
+ * @brief Maps the ids of the cached pages to their frames.
+ *
+ * Open addressing with robin hood probing and backward shift deletion, over a flat array allocated once:
+ * at least twice the pool size, rounded up to a power of two, so the load factor stays at most 1/2
+ * and probe sequences are short. Nothing is allocated after construction.
+ */
+class PageTable {
+  public:
+    using frame_id_t = int;
+    static constexpr frame_id_t kNotFound = -1;
+    explicit PageTable(size_t pool_size);
+
+    /// @return the frame of the page, or kNotFound
+    auto Find(page_id_t page_id) const -> frame_id_t {
+      for (size_t i = Home(page_id), dist = 0;; i = (i + 1) & mask_, ++dist) {
+        const Slot &slot = slots_[i];
+        if (slot.page_id == page_id) return slot.frame_id;
+        if (slot.page_id == INVALID_PAGE_ID || Distance(slot.page_id, i) < dist) return kNotFound;
+      }
+    }
+    auto Contains(page_id_t page_id) const -> bool { return Find(page_id) != kNotFound; }
+    /// @brief Insert, or update the frame if the page is already present
+    void Insert(page_id_t page_id, frame_id_t frame_id);
+    void Erase(page_id_t page_id);
+
+  private:
+    struct Slot {
+      page_id_t page_id = INVALID_PAGE_ID;
+      frame_id_t frame_id = kNotFound;
+    };
+    std::vector<Slot> slots_;
+    size_t mask_;
+    int shift_; // 64 - log2(capacity)
+
+    auto Home(page_id_t page_id) const -> size_t {
+      // Fibonacci hashing: page ids are dense, the multiplication spreads neighbours apart
+      return (static_cast<uint64_t>(static_cast<uint32_t>(page_id)) * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+    auto Distance(page_id_t page_id, size_t slot) const -> size_t { return (slot - Home(page_id)) & mask_; }
+};
+} // namespace storage
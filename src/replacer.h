@@ -0,0 +1,44 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#pragma once
+#include <config.h>
+
+#include "arc_replacer.h"
+#include "clock_replacer.h"
+#include "lru_k_replacer.h"
+#include "two_queue_replacer.h"
+
+namespace storage {
+/**
+ * Every replacer provides, with `frame_id_t` = int:
+ * - `explicit Replacer(size_t pool_size)`
+ * - `Evict(frame_id_t *)`: pick an evictable frame and forget it, false if there is none
+ * - `RecordAccess(frame_id_t, page_id_t)`: the frame was accessed; a frame the replacer does not track
+ *   has just been loaded with the page
+ * - `SetEvictable(frame_id_t)` / `SetNonevictable(frame_id_t)`
+ * - `Remove(frame_id_t)`: forget the frame without evicting it
+ * - `Size()`: number of evictable frames
+ * - `Coldest(size_t n, std::vector<frame_id_t> *)`: up to n evictable frames, the next victims first
+ */
+template<ReplacerPolicy Policy>
+struct ReplacerOf;
+template<>
+struct ReplacerOf<ReplacerPolicy::LRU_K> {
+  using type = LRUKReplacer;
+};
+template<>
+struct ReplacerOf<ReplacerPolicy::CLOCK> {
+  using type = ClockReplacer;
+};
+template<>
+struct ReplacerOf<ReplacerPolicy::TWO_Q> {
+  using type = TwoQueueReplacer;
+};
+template<>
+struct ReplacerOf<ReplacerPolicy::ARC> {
+  using type = ARCReplacer;
+};
+using DefaultReplacer = ReplacerOf<BUFFER_POOL_REPLACER>::type;
+} // namespace storage
@@ -0,0 +1,79 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#include "replacer_lists.h"
+
+namespace storage {
+IntrusiveLists::IntrusiveLists(int elements, int lists) : elements_(elements),
+                                                           links_(elements + lists),
+                                                           list_of_(elements, kNone),
+                                                           parked_(elements, 0),
+                                                           sizes_(lists, 0) {
+  for (int list = 0; list < lists; ++list) {
+    links_[Head(list)] = {Head(list), Head(list)};
+  }
+}
+void IntrusiveLists::PushBack(int list, index_t x) {
+  index_t head = Head(list), last = links_[head].prev;
+  links_[x] = {last, head};
+  links_[last].next = x;
+  links_[head].prev = x;
+  list_of_[x] = list;
+  ++sizes_[list];
+}
+void IntrusiveLists::Erase(index_t x) {
+  if (parked_[x]) {
+    parked_[x] = 0;
+  } else {
+    auto [prev, next] = links_[x];
+    links_[prev].next = next;
+    links_[next].prev = prev;
+  }
+  --sizes_[list_of_[x]];
+  list_of_[x] = kNone;
+}
+void IntrusiveLists::Park(index_t x) {
+  int list = list_of_[x];
+  Erase(x);
+  list_of_[x] = list;
+  ++sizes_[list];
+  parked_[x] = 1;
+}
+void IntrusiveLists::Unpark(index_t x) {
+  int list = list_of_[x];
+  parked_[x] = 0;
+  --sizes_[list];
+  PushBack(list, x);
+}
+
+GhostList::GhostList(size_t capacity) : pages_(capacity, INVALID_PAGE_ID), slot_of_(capacity),
+                                        lists_(static_cast<int>(capacity), 1) {
+  free_slots_.reserve(capacity);
+  for (int slot = static_cast<int>(capacity) - 1; slot >= 0; --slot) {
+    free_slots_.push_back(slot);
+  }
+}
+void GhostList::Push(page_id_t page_id) {
+  if (Capacity() == 0) return;
+  Erase(page_id);
+  if (free_slots_.empty()) PopOldest();
+  int slot = free_slots_.back();
+  free_slots_.pop_back();
+  pages_[slot] = page_id;
+  slot_of_.Insert(page_id, slot);
+  lists_.PushBack(0, slot);
+}
+auto GhostList::Erase(page_id_t page_id) -> bool {
+  int slot = slot_of_.Find(page_id);
+  if (slot == PageTable::kNotFound) return false;
+  lists_.Erase(slot);
+  free_slots_.push_back(slot);
+  slot_of_.Erase(page_id);
+  return true;
+}
+void GhostList::PopOldest() {
+  if (lists_.Empty(0)) return;
+  Erase(pages_[lists_.Front(0)]);
+}
+} // namespace storage
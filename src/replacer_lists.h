@@ -0,0 +1,75 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#pragma once
+#include <config.h>
+#include <cstdint>
+#include <vector>
+
+#include "page_table.h"
+
+namespace storage {
+/**
+ * @brief Doubly linked lists threaded through one array, for the replacers.
+ *
+ * Elements are the indices [0, elements); each is in at most one of the lists at a time.
+ * An element can be parked: it stays a member of its list, and counts towards its size, but is out of its order
+ * until it is unparked at the end. The replacers park pinned frames, so that they do not walk past them.
+ * Every operation is O(1) and nothing is allocated after construction.
+ */
+class IntrusiveLists {
+  public:
+    using index_t = int;
+    static constexpr index_t kNone = -1;
+    IntrusiveLists(int elements, int lists);
+
+    void PushBack(int list, index_t x);
+    void Erase(index_t x); // x must be in a list, parked or not
+    void Park(index_t x); // x must be in a list, and not parked
+    void Unpark(index_t x); // back at the end of its list
+    auto Parked(index_t x) const -> bool { return parked_[x]; }
+    auto Front(int list) const -> index_t { return Valid(links_[Head(list)].next); }
+    auto Next(index_t x) const -> index_t { return Valid(links_[x].next); }
+    auto Size(int list) const -> int { return sizes_[list]; }
+    auto Empty(int list) const -> bool { return sizes_[list] == 0; }
+    auto Contains(index_t x) const -> bool { return list_of_[x] != kNone; }
+    auto ListOf(index_t x) const -> int { return list_of_[x]; }
+
+  private:
+    struct Link {
+      index_t prev, next;
+    };
+    const int elements_;
+    std::vector<Link> links_; // elements first, then one head per list
+    std::vector<int> list_of_;
+    std::vector<uint8_t> parked_;
+    std::vector<int> sizes_;
+
+    auto Head(int list) const -> index_t { return elements_ + list; }
+    auto Valid(index_t x) const -> index_t { return x >= elements_ ? kNone : x; }
+};
+
+/**
+ * @brief A bounded FIFO of the ids of recently evicted pages, for the policies that remember pages
+ * they no longer cache (the A1out queue of 2Q, the B1 / B2 lists of ARC).
+ */
+class GhostList {
+  public:
+    explicit GhostList(size_t capacity);
+
+    /// @brief Push as the newest entry, dropping the oldest one if full
+    void Push(page_id_t page_id);
+    /// @brief Remove the page if present, returns whether it was
+    auto Erase(page_id_t page_id) -> bool;
+    void PopOldest();
+    auto Size() const -> int { return lists_.Size(0); }
+    auto Capacity() const -> int { return static_cast<int>(pages_.size()); }
+
+  private:
+    std::vector<page_id_t> pages_; // page of each slot
+    std::vector<int> free_slots_;
+    PageTable slot_of_; // the flat map of the buffer pool, from page ids to slots here
+    IntrusiveLists lists_; // a single list, oldest first
+};
+} // namespace storage
@@ -33,16 +33,18 @@ struct TicketSimpleInfo {
 
 class TicketManager {
   public:
-    TicketManager(storage::BufferPoolManager<storage::VLS_PAGES_PER_FRAME> *bpm,
-                  storage::VarLengthStore *vls,
-                  bool reset) : ticket_index_(bpm, bpm->AllocateInfo(), reset),
+    TicketManager(storage::BufferPoolManager<storage::BPT_PAGES_PER_FRAME> *bpm,
+                  storage::BufferPoolManager<storage::BPT_SCAN_PAGES_PER_FRAME> *scan_bpm,
+                  storage::VarLengthStore<> *vls,
+                  bool reset) : ticket_index_(scan_bpm, scan_bpm->AllocateInfo(), reset),
                                 pending_queue_(bpm, bpm->AllocateInfo(), reset) {
     }
 
   protected:
     storage::BPlusTree<
-      storage::PackedPair<storage::record_id_t, order_no_t>,
-      TicketInfo> ticket_index_; // <user_id, -order_no> -> ticket_info
+      storage::PackedPair<storage::record_id_t, order_no_t>, TicketInfo,
+      storage::BPT_INTERNAL_LAYOUT,
+      storage::BPT_SCAN_PAGES_PER_FRAME> ticket_index_; // <user_id, -order_no> -> ticket_info
     storage::BPlusTree<
       storage::PackedPair<
         storage::PackedPair<storage::record_id_t, date_t>,
@@ -4,7 +4,37 @@
 
 #include "ticket_system.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
 namespace business {
+namespace {
+constexpr char kCompactSuffix[] = ".compact"; // the new db files of a compaction
+constexpr char kCompactDoneSuffix[] = ".compact_done"; // marks that all the new db files are complete
+constexpr char kSnapshotSuffix[] = ".snapshot"; // the copies of the db files made by a snapshot
+constexpr char kSnapshotDoneSuffix[] = ".snapshot_done"; // marks that all the copies are complete
+
+/// @brief fsync a file, or a directory so that the files created or renamed in it are durable
+void SyncPath(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0 || fsync(fd) != 0) {
+    if (fd >= 0) close(fd);
+    throw std::runtime_error("Cannot sync file " + path);
+  }
+  close(fd);
+}
+auto DirectoryOf(const std::string &file_name) -> std::string {
+  auto directory = std::filesystem::path(file_name).parent_path();
+  return directory.empty() ? "." : directory.string();
+}
+} // namespace
 void TicketSystem::BuyTicket(int timestamp, std::string_view username,
                              std::string_view train_name, date_t date,
                              std::string_view from_str,
@@ -43,11 +73,10 @@ void TicketSystem::BuyTicket(int timestamp, std::string_view username,
   if (seat_count > train_info->seat_count) {
     return utils::FastIO::WriteFailure(); // too many tickets
   }
-  auto vacancy_handle = vls()->Get<Vacancy>(
-      train_info->GetVacancyId(depart_date));
+  auto vacancy_handle = vacancy_vls()->Get<Vacancy>(train_info->vacancy_id);
   auto vacancy = vacancy_handle.Get();
   bool pending = false;
-  if (vacancy->GetVacancy(train_info->station_count, depart_date, from_no,
+  if (vacancy->GetVacancy(train_info->station_count, train_info->date_beg, depart_date, from_no,
                           to_no) < seat_count) {
     if (!agree_to_wait) {
       return utils::FastIO::WriteFailure(); // not enough tickets
@@ -84,6 +113,7 @@ void TicketSystem::BuyTicket(int timestamp, std::string_view username,
   } else {
     vacancy_handle->ReduceVacancy(
         train_info->station_count,
+        train_info->date_beg,
         depart_date,
         from_no,
         to_no,
@@ -162,11 +192,11 @@ void TicketSystem::RefundTicket(std::string_view username,
     // restore vacancy
     auto train_handle = vls()->Get<TrainInfo>(ticket.train_id);
     auto train = train_handle.Get();
-    auto vacancy_handle = vls()->Get<Vacancy>(
-        train->GetVacancyId(ticket.date));
+    auto vacancy_handle = vacancy_vls()->Get<Vacancy>(train->vacancy_id);
     auto vacancy = vacancy_handle.GetMut();
     vacancy->ReduceVacancy(
         train->station_count,
+        train->date_beg,
         ticket.date,
         ticket.from,
         ticket.to,
@@ -181,7 +211,7 @@ void TicketSystem::RefundTicket(std::string_view username,
            storage::make_packed_pair(ticket.train_id, ticket.date);
            ++pending_it) {
       if (vacancy->GetVacancy(
-              train->station_count, ticket.date,
+              train->station_count, train->date_beg, ticket.date,
               pending_it.Value().from, pending_it.Value().to) <
           pending_it.Value().seat_count) {
         continue;
@@ -199,6 +229,7 @@ void TicketSystem::RefundTicket(std::string_view username,
       ticket2.status = TicketStatus::SUCCESS;
       vacancy->ReduceVacancy(
           train->station_count,
+          train->date_beg,
           ticket.date,
           pending_it.Value().from,
           pending_it.Value().to,
@@ -208,10 +239,9 @@ void TicketSystem::RefundTicket(std::string_view username,
            static_cast<order_no_t>(-pending_it.Value().order_no)},
           ticket2, pos2);
     }
-    for (auto& key : to_delete) {
-      bool result = pending_queue_.Remove(key);
-      ASSERT(result);
-    }
+    // collected in key order, so the keys sharing a leaf are removed after a single descent
+    [[maybe_unused]] auto removed = pending_queue_.RemoveBatch(to_delete);
+    ASSERT(removed == to_delete.size());
   }
   ticket.status = TicketStatus::REFUNDED;
   ticket_index_.SetValue(
@@ -219,4 +249,176 @@ void TicketSystem::RefundTicket(std::string_view username,
       ticket, pos);
   utils::FastIO::WriteSuccess();
 }
+auto TicketSystem::Compact(std::unique_ptr<TicketSystem> ticket_system,
+                           const std::string &db_file_name,
+                           const std::string &scan_db_file_name,
+                           const std::string &vacancy_db_file_name) -> std::unique_ptr<TicketSystem> {
+  {
+    // not logged: the copy is dropped unless it completes, and the whole db would sit in one group of the log
+    TicketSystem compacted(db_file_name + kCompactSuffix, scan_db_file_name + kCompactSuffix,
+                           vacancy_db_file_name + kCompactSuffix, true, false);
+    ticket_system->CopyInto(&compacted);
+  } // the ticket systems write their frames back when destroyed
+  ticket_system.reset();
+  // the copy is not logged: it must be on disk before the marker lets it replace the db files
+  for (const auto &file_name : {db_file_name, scan_db_file_name, vacancy_db_file_name}) {
+    SyncPath(file_name + kCompactSuffix);
+  }
+  SyncPath(DirectoryOf(db_file_name));
+  std::ofstream(db_file_name + kCompactDoneSuffix).close();
+  SyncPath(db_file_name + kCompactDoneSuffix);
+  SyncPath(DirectoryOf(db_file_name));
+  RecoverCompaction(db_file_name, scan_db_file_name, vacancy_db_file_name);
+  return std::make_unique<TicketSystem>(db_file_name, scan_db_file_name, vacancy_db_file_name);
+}
+void TicketSystem::RecoverCompaction(const std::string &db_file_name,
+                                     const std::string &scan_db_file_name,
+                                     const std::string &vacancy_db_file_name) {
+  namespace fs = std::filesystem;
+  bool done = fs::exists(db_file_name + kCompactDoneSuffix);
+  for (const auto &file_name : {db_file_name, scan_db_file_name, vacancy_db_file_name}) {
+    if (!fs::exists(file_name + kCompactSuffix)) continue; // not written yet, or renamed already
+    if (done) {
+      fs::rename(file_name + kCompactSuffix, file_name);
+    } else {
+      fs::remove(file_name + kCompactSuffix);
+    }
+  }
+  if (done) SyncPath(DirectoryOf(db_file_name)); // the renames, before the marker that redoes them is gone
+  fs::remove(db_file_name + kCompactDoneSuffix);
+}
+auto TicketSystem::BeginSnapshot() -> bool {
+  if (snapshotting_) return false;
+  if (!bpm_.SnapshotSupported() || !scan_bpm_.SnapshotSupported() || !vacancy_bpm_.SnapshotSupported()) {
+    return false;
+  }
+  std::filesystem::remove(db_file_name_ + kSnapshotDoneSuffix); // the last snapshot is overwritten
+  // the db files hold a consistent state right after a commit
+  WriteBackOrderCounts();
+  Commit();
+  bpm_.BeginSnapshot(db_file_name_ + kSnapshotSuffix);
+  scan_bpm_.BeginSnapshot(scan_db_file_name_ + kSnapshotSuffix);
+  vacancy_bpm_.BeginSnapshot(vacancy_db_file_name_ + kSnapshotSuffix);
+  snapshotting_ = true;
+  return true;
+}
+void TicketSystem::StepSnapshot() {
+  bool done = bpm_.SnapshotStep(storage::SNAPSHOT_STEP_SIZE);
+  done &= scan_bpm_.SnapshotStep(storage::SNAPSHOT_STEP_SIZE);
+  done &= vacancy_bpm_.SnapshotStep(storage::SNAPSHOT_STEP_SIZE);
+  if (!done) return;
+  std::ofstream(db_file_name_ + kSnapshotDoneSuffix).close();
+  snapshotting_ = false;
+}
+void TicketSystem::StepScrub() {
+  auto report = [](const std::string &file_name, const std::vector<storage::page_id_t> &corrupt) {
+    for (auto page_id : corrupt) {
+      std::cerr << "Checksum mismatch in frame " << page_id << " of " << file_name << std::endl;
+    }
+  };
+  report(db_file_name_, bpm_.ScrubStep(storage::SCRUB_STEP_SIZE));
+  report(scan_db_file_name_, scan_bpm_.ScrubStep(storage::SCRUB_STEP_SIZE));
+  report(vacancy_db_file_name_, vacancy_bpm_.ScrubStep(storage::SCRUB_STEP_SIZE));
+}
+auto TicketSystem::RestoreSnapshot(const std::string &db_file_name,
+                                   const std::string &scan_db_file_name,
+                                   const std::string &vacancy_db_file_name) -> bool {
+  namespace fs = std::filesystem;
+  if (!fs::exists(db_file_name + kSnapshotDoneSuffix)) return false;
+  for (const auto &file_name : {db_file_name, scan_db_file_name, vacancy_db_file_name}) {
+    fs::rename(file_name + kSnapshotSuffix, file_name);
+  }
+  fs::remove(db_file_name + kSnapshotDoneSuffix);
+  return true;
+}
+void TicketSystem::RecoverSnapshot(const std::string &db_file_name,
+                                   const std::string &scan_db_file_name,
+                                   const std::string &vacancy_db_file_name) {
+  namespace fs = std::filesystem;
+  if (!fs::exists(db_file_name + kSnapshotDoneSuffix)) return;
+  std::initializer_list<std::string> file_names = {db_file_name, scan_db_file_name, vacancy_db_file_name};
+  // a complete snapshot has all of its files, a restore renames them one by one
+  if (std::all_of(file_names.begin(), file_names.end(),
+                  [](const auto &file_name) { return fs::exists(file_name + kSnapshotSuffix); })) {
+    return;
+  }
+  for (const auto &file_name : file_names) {
+    if (fs::exists(file_name + kSnapshotSuffix)) fs::rename(file_name + kSnapshotSuffix, file_name);
+  }
+  fs::remove(db_file_name + kSnapshotDoneSuffix);
+}
+void TicketSystem::CopyInto(TicketSystem *dst) {
+  using storage::record_id_t;
+  std::unordered_map<record_id_t, record_id_t> new_id; // of every record copied so far
+  // copy the record of every entry of a hash index, whose keys and their order stay the same
+  auto copy_records = [&new_id](auto &index, auto &dst_index, auto copy_record) {
+    std::vector<std::pair<storage::hash_t, record_id_t> > entries;
+    for (auto it = index.LowerBound(0); it != index.End(); ++it) {
+      entries.emplace_back(it.Key(), new_id[it.Value()] = copy_record(it.Value()));
+    }
+    dst_index.BulkLoad(entries.begin(), entries.end());
+  };
+  copy_records(station_id_index_, dst->station_id_index_, [this, dst](record_id_t station_id) {
+    auto station_name = vls()->Get<StationName>(station_id);
+    auto size = std::strlen(station_name->name) + 1;
+    auto copy = dst->vls()->Allocate<StationName>(size);
+    std::memcpy(copy->name, station_name->name, size);
+    return copy.RecordID();
+  });
+  copy_records(user_id_index_, dst->user_id_index_, [this, dst](record_id_t user_id) {
+    auto copy = dst->vls()->Allocate<UserProfile>();
+    std::memcpy(copy.GetMut(), vls()->Get<UserProfile>(user_id).Get(), vls()->GetObjectSize<UserProfile>());
+    return copy.RecordID();
+  });
+  copy_records(train_id_index_, dst->train_id_index_, [this, dst, &new_id](record_id_t train_id) {
+    auto train_info = vls()->Get<TrainInfo>(train_id);
+    int size = train_info->station_count - 1;
+    auto copy = dst->vls()->Allocate<TrainInfo>(size);
+    std::memcpy(copy.GetMut(), train_info.Get(), vls()->GetObjectSize<TrainInfo>(size));
+    copy->depart_station = new_id.at(copy->depart_station);
+    for (int i = 0; i < size; ++i) {
+      copy->station[i].station_id = new_id.at(copy->station[i].station_id);
+    }
+    if (copy->IsReleased()) {
+      int vacancy_size = (copy->date_end - copy->date_beg + 1) * size;
+      auto vacancy = dst->vacancy_vls()->Allocate<Vacancy>(vacancy_size);
+      std::memcpy(vacancy.GetMut(), vacancy_vls()->Get<Vacancy>(copy->vacancy_id).Get(),
+                  vacancy_vls()->GetObjectSize<Vacancy>(vacancy_size));
+      copy->vacancy_id = vacancy.RecordID();
+    }
+    return copy.RecordID();
+  });
+  // the other indexes have record ids in their keys, so their entries are sorted again
+  auto bulk_load = [](auto &dst_index, auto &entries) {
+    storage::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    dst_index.BulkLoad(entries.begin(), entries.end());
+  };
+  std::vector<std::pair<storage::PackedPair<record_id_t, record_id_t>, storage::NoValue> > station_trains;
+  for (auto it = station_train_index_.LowerBound({}); it != station_train_index_.End(); ++it) {
+    auto key = it.Key();
+    station_trains.emplace_back(storage::make_packed_pair(new_id.at(key.first), new_id.at(key.second)),
+                                storage::NoValue{});
+  }
+  bulk_load(dst->station_train_index_, station_trains);
+  std::vector<std::pair<storage::PackedPair<record_id_t, order_no_t>, TicketInfo> > tickets;
+  // order numbers are stored negated
+  for (auto it = ticket_index_.LowerBound({0, std::numeric_limits<order_no_t>::min()}); it != ticket_index_.End();
+       ++it) {
+    auto key = it.Key();
+    auto ticket = it.Value();
+    ticket.train_id = new_id.at(ticket.train_id);
+    tickets.emplace_back(storage::make_packed_pair(new_id.at(key.first), key.second), ticket);
+  }
+  bulk_load(dst->ticket_index_, tickets);
+  std::vector<std::pair<storage::PackedPair<storage::PackedPair<record_id_t, date_t>, int>, TicketSimpleInfo> >
+      pending_tickets;
+  for (auto it = pending_queue_.LowerBound({}); it != pending_queue_.End(); ++it) {
+    auto key = it.Key();
+    auto ticket = it.Value();
+    ticket.user_id = new_id.at(ticket.user_id);
+    key.first.first = new_id.at(key.first.first);
+    pending_tickets.emplace_back(key, ticket);
+  }
+  bulk_load(dst->pending_queue_, pending_tickets);
+}
 } // namespace business
\ No newline at end of file
@@ -7,7 +7,9 @@
 #include <buffer_pool_manager.h>
 #include <hash.h>
 #include <variable_length_store.h>
+#include <write_ahead_log.h>
 
+#include <memory>
 #include <string>
 
 #include "ticket_manager.h"
@@ -17,20 +19,74 @@
 namespace business {
 class TicketSystemBase {
   protected:
-    TicketSystemBase(const std::string &db_file_name, bool reset)
-      : db_file_name_(db_file_name), bpm_(db_file_name, reset), vls_(&bpm_, bpm_.AllocateInfo(), reset) {
+    TicketSystemBase(const std::string &db_file_name,
+                     const std::string &scan_db_file_name,
+                     const std::string &vacancy_db_file_name,
+                     bool reset,
+                     bool logged)
+      : db_file_name_(db_file_name),
+        scan_db_file_name_(scan_db_file_name),
+        vacancy_db_file_name_(vacancy_db_file_name),
+        log_(logged ? std::make_unique<storage::WriteAheadLog>(db_file_name + storage::WAL_FILE_SUFFIX, reset)
+                    : nullptr),
+        bpm_(db_file_name, reset, storage::BUFFER_POOL_SIZE - kScanPoolPages - kVacancyPoolPages,
+             storage::BUFFER_POOL_MODE, storage::BPM_CLEANER_ENABLED, kConcurrentPools),
+        scan_bpm_(scan_db_file_name, reset, kScanPoolPages / storage::BPT_SCAN_PAGES_PER_FRAME,
+                  storage::BUFFER_POOL_MODE, storage::BPM_CLEANER_ENABLED, kConcurrentPools),
+        vacancy_bpm_(vacancy_db_file_name, reset, kVacancyPoolPages / storage::VLS_VACANCY_PAGES_PER_FRAME,
+                     storage::BUFFER_POOL_MODE, storage::BPM_CLEANER_ENABLED, kConcurrentPools),
+        vls_(&bpm_, bpm_.AllocateInfo(), reset),
+        vacancy_vls_(&vacancy_bpm_, vacancy_bpm_.AllocateInfo(), reset) {
+      vacancy_bpm_.SetCompression(storage::VLS_VACANCY_COMPRESSION);
+      if (log_ == nullptr) return;
+      bpm_.AttachLog(log_.get());
+      scan_bpm_.AttachLog(log_.get());
+      vacancy_bpm_.AttachLog(log_.get());
+      log_->Recover(); // before anything is read from the db files
+    }
+    ~TicketSystemBase() {
+      if (log_ == nullptr) return;
+      Commit();
+      log_->Checkpoint();
+    }
+
+    /// @brief Write back the dirty frames of all pools, and commit them as one group of the log if there is one
+    void Commit(bool force = false) {
+      bpm_.FlushDirtyFrames();
+      scan_bpm_.FlushDirtyFrames();
+      vacancy_bpm_.FlushDirtyFrames();
+      if (log_ != nullptr) log_->Commit(force);
     }
 
+    // the other pools get their share of the memory, not of the frames
+    static constexpr size_t kScanPoolPages = storage::BUFFER_POOL_SIZE * storage::BPM_SCAN_POOL_SHARE;
+    static constexpr size_t kVacancyPoolPages = storage::BUFFER_POOL_SIZE * storage::BPM_VACANCY_POOL_SHARE;
+    // concurrent trees need concurrent pools; the ticket system itself runs its commands on one thread all the same
+    static constexpr bool kConcurrentPools = storage::BPM_CONCURRENT || storage::BPT_CONCURRENT;
     const std::string db_file_name_;
-    storage::BufferPoolManager<1> bpm_;
-    storage::VarLengthStore vls_;
+    const std::string scan_db_file_name_;
+    const std::string vacancy_db_file_name_;
+    std::unique_ptr<storage::WriteAheadLog> log_; // nullptr if not logged; outlives the pools, which write through it
+    storage::BufferPoolManager<storage::BPT_PAGES_PER_FRAME> bpm_; // VarLengthStore and the point lookup trees
+    storage::BufferPoolManager<storage::BPT_SCAN_PAGES_PER_FRAME> scan_bpm_; // the scan-heavy trees
+    storage::BufferPoolManager<storage::VLS_VACANCY_PAGES_PER_FRAME> vacancy_bpm_; // the vacancy matrices
+    storage::VarLengthStore<> vls_;
+    VacancyStore vacancy_vls_;
 };
 class TicketSystem : public TicketSystemBase, public UserManager, public TicketManager, public TrainManager {
   public:
-    explicit TicketSystem(const std::string &db_file_name, bool reset = false) : TicketSystemBase(db_file_name, reset),
+    explicit TicketSystem(const std::string &db_file_name,
+                          const std::string &scan_db_file_name,
+                          const std::string &vacancy_db_file_name,
+                          bool reset = false,
+                          bool logged = storage::WAL_ENABLED)
+      : TicketSystemBase(db_file_name, scan_db_file_name, vacancy_db_file_name, reset, logged),
       UserManager(&bpm_, &(TicketSystemBase::vls_), reset),
-      TicketManager(&bpm_, &(TicketSystemBase::vls_), reset),
-      TrainManager(&bpm_, &(TicketSystemBase::vls_), reset) {
+      TicketManager(&bpm_, &scan_bpm_, &(TicketSystemBase::vls_), reset),
+      TrainManager(&bpm_, &scan_bpm_, &(TicketSystemBase::vls_), &(TicketSystemBase::vacancy_vls_), reset) {
+      // commit the empty db right away, info pages included: a crash before the first group would leave files of
+      // zeros, which the next start would open as a db whose roots are all frame 0
+      if (reset) Commit(true);
     }
 
     void BuyTicket(int timestamp,
@@ -46,7 +102,77 @@ class TicketSystem : public TicketSystemBase, public UserManager, public TicketM
 
     void RefundTicket(std::string_view username, order_no_t order_no);
 
+    /**
+     * @brief Count a finished command towards the current group of the log, and commit the group once it is due.
+     * Also steps a snapshot in progress and the scrub of the db files.
+     * @return Whether a group was committed
+     */
+    auto EndCommand() -> bool {
+      if (snapshotting_) StepSnapshot();
+      static_assert(storage::SCRUB_STEP_SIZE == 0 || storage::BUFFER_POOL_MODE == storage::BufferPoolMode::COPY,
+                    "the scrub would report the dirty frames of a ZERO_COPY pool");
+      if constexpr (storage::SCRUB_STEP_SIZE > 0) StepScrub();
+      if (log_ == nullptr || !log_->CommandDone()) return false;
+      CommitGroup();
+      return true;
+    }
+    /// @brief Commit the current group of the log now, e.g. before waiting for more commands
+    void CommitGroup() {
+      if (log_ == nullptr) return;
+      WriteBackOrderCounts();
+      Commit();
+    }
+    auto Logged() const -> bool { return log_ != nullptr; }
+
+    auto GarbageRatio() const -> double { return TicketSystemBase::vls_.GarbageRatio(); }
+
+    /**
+     * @brief Copy the live records of `ticket_system` to new db files, rebuild the indexes on the new record ids
+     * with `BulkLoad`, and replace the old files with the new ones.
+     * No record id may be held outside the db, e.g. by a logged-in user.
+     * @return The ticket system on the compacted files
+     */
+    static auto Compact(std::unique_ptr<TicketSystem> ticket_system,
+                        const std::string &db_file_name,
+                        const std::string &scan_db_file_name,
+                        const std::string &vacancy_db_file_name) -> std::unique_ptr<TicketSystem>;
+
+    /// @brief Finish the file swap of a compaction that was interrupted, or drop its half-written files
+    static void RecoverCompaction(const std::string &db_file_name,
+                                  const std::string &scan_db_file_name,
+                                  const std::string &vacancy_db_file_name);
+
+    /**
+     * @brief Start an online snapshot of the db files, as they are now, to files next to them.
+     * Every later command copies `SNAPSHOT_STEP_SIZE` bytes of each file; a frame about to be overwritten is copied
+     * first. A snapshot that is not complete at shutdown is dropped.
+     * @return false if a snapshot is in progress, or if a pool cannot take one; nothing is changed then
+     */
+    auto BeginSnapshot() -> bool;
+
+    /**
+     * @brief Replace the db files by the last complete snapshot, which is used up; the files must not be open.
+     * The snapshot files are db files themselves, so the ticket system opened on them next has nothing to replay.
+     * @return false if there is no complete snapshot
+     */
+    static auto RestoreSnapshot(const std::string &db_file_name,
+                                const std::string &scan_db_file_name,
+                                const std::string &vacancy_db_file_name) -> bool;
+
+    /// @brief Finish a restore that was interrupted
+    static void RecoverSnapshot(const std::string &db_file_name,
+                                const std::string &scan_db_file_name,
+                                const std::string &vacancy_db_file_name);
+
   private:
-    storage::VarLengthStore *vls() { return &(TicketSystemBase::vls_); }
+    storage::VarLengthStore<> *vls() { return &(TicketSystemBase::vls_); }
+    VacancyStore *vacancy_vls() { return &(TicketSystemBase::vacancy_vls_); }
+
+    void CopyInto(TicketSystem *dst);
+
+    bool snapshotting_ = false;
+    void StepSnapshot();
+    /// @brief Check the next `SCRUB_STEP_SIZE` bytes of each db file, and report the corrupt frames on stderr
+    void StepScrub();
 };
 } // namespace business
@@ -54,35 +54,35 @@ GetDepartDate(date_t leaving_date, int leaving_station) const {
   return leaving_date - (depart_time + station[leaving_station - 1].leave_time)
          / 1440;
 }
-int Vacancy::GetVacancy(int8_t station_count, date_t date,
+int Vacancy::GetVacancy(int8_t station_count, date_t date_beg, date_t date,
                         int station_no) const {
   ASSERT(station_no < station_count - 1); // the last station is not included
-  return vacancy[(date % DATE_BATCH_SIZE) * (station_count - 1) + station_no];
+  return vacancy[(date - date_beg) * (station_count - 1) + station_no];
 }
-const int* Vacancy::GetVacancy(int8_t station_count, date_t date) const {
-  return vacancy + (date % DATE_BATCH_SIZE) * (station_count - 1);
+const int* Vacancy::GetVacancy(int8_t station_count, date_t date_beg, date_t date) const {
+  return vacancy + (date - date_beg) * (station_count - 1);
 }
-int* Vacancy::GetVacancy(int8_t station_count, date_t date) {
-  return vacancy + (date % DATE_BATCH_SIZE) * (station_count - 1);
+int* Vacancy::GetVacancy(int8_t station_count, date_t date_beg, date_t date) {
+  return vacancy + (date - date_beg) * (station_count - 1);
 }
-int Vacancy::GetVacancy(int8_t station_count, date_t date, int from,
+int Vacancy::GetVacancy(int8_t station_count, date_t date_beg, date_t date, int from,
                         int to) const {
   ASSERT(from < station_count && to < station_count && from < to);
   // the last station is not included
   // the vacancy of a range [from, to] is the minimum of the vacancies of all the stations in the range
   // TODO(opt): use SIMD
   int min_vacancy = std::numeric_limits<int>::max();
-  auto vacancy = this->GetVacancy(station_count, date);
+  auto vacancy = this->GetVacancy(station_count, date_beg, date);
   for (int i = from; i < to; ++i) {
     min_vacancy = std::min(min_vacancy, vacancy[i]);
   }
   return min_vacancy;
 }
-void Vacancy::ReduceVacancy(int8_t station_count, date_t date, int from, int to,
+void Vacancy::ReduceVacancy(int8_t station_count, date_t date_beg, date_t date, int from, int to,
                             int num) {
   ASSERT(from < station_count && to < station_count && from < to);
   // the last station is not included
-  auto vacancy = this->GetVacancy(station_count, date);
+  auto vacancy = this->GetVacancy(station_count, date_beg, date);
   for (int i = from; i < to; ++i) {
     vacancy[i] -= num;
     ASSERT(vacancy[i] >= 0);
@@ -96,7 +96,7 @@ void TrainManager::AddTrain(std::string_view train_name, int8_t station_count,
                             utils::Parser::DelimitedStrIterator stopover_times,
                             utils::Parser::DelimitedStrIterator sell_dates) {
   // 1. Allocate space for the train
-  storage::VarLengthStore::Handle<TrainInfo> train_info_handle;
+  storage::VarLengthStore<>::Handle<TrainInfo> train_info_handle;
   auto generate_train_id = [station_count, &train_info_handle, this] {
     auto size = station_count - 1;
     train_info_handle = vls_->Allocate<
@@ -120,8 +120,7 @@ void TrainManager::AddTrain(std::string_view train_name, int8_t station_count,
   train_info->date_end = utils::Parser::ParseDate(*++sell_dates);
   train_info->depart_station = GetStationId(*stations);
   // Set the vacancy id to INVALID_RECORD_ID because the train has not been released
-  std::fill_n(train_info->vacancy_id, DATE_BATCH_COUNT,
-              storage::INVALID_RECORD_ID);
+  train_info->vacancy_id = storage::INVALID_RECORD_ID;
   // 3. Fill the station information
   time_t total_time = 0;
   int total_price = 0;
@@ -153,11 +152,14 @@ void TrainManager::DeleteTrain(std::string_view train_name) {
   if (!train_id_index_.GetValue(train_id_hash, &train_id)) {
     return utils::FastIO::WriteFailure();
   }
-  if (vls_->Get<TrainInfo>(train_id).Get()->IsReleased()) {
+  auto train_info_handle = vls_->Get<TrainInfo>(train_id);
+  if (train_info_handle.Get()->IsReleased()) {
     return utils::FastIO::WriteFailure();
   }
+  auto station_count = train_info_handle.Get()->station_count;
   train_id_index_.Remove(train_id_hash);
-  // the VLS does not support deletion, so we just do nothing here
+  // an unreleased train has neither vacancies nor entries in the other indexes
+  vls_->Free<TrainInfo>(train_id, station_count - 1);
   utils::FastIO::WriteSuccess();
 }
 void TrainManager::ReleaseTrain(std::string_view train_name) {
@@ -173,19 +175,21 @@ void TrainManager::ReleaseTrain(std::string_view train_name) {
   // 0. Set the train as released
   train_info->released = true;
   // 1. Add vacancy information
-  size_t vacancy_size = DATE_BATCH_SIZE * (train_info->station_count - 1);
-  for (int i = train_info->date_beg / DATE_BATCH_SIZE;
-       i <= train_info->date_end / DATE_BATCH_SIZE; ++i) {
-    auto vacancy = vls_->Allocate<Vacancy>(vacancy_size);
-    train_info->vacancy_id[i] = vacancy.RecordID();
-    std::fill_n(vacancy->vacancy, vacancy_size, train_info->seat_count);
-  }
-  // 2. Add the train to the station's train list
-  station_train_index_.Insert({train_info->depart_station, train_id}, 'a');
+  size_t vacancy_size = (train_info->date_end - train_info->date_beg + 1) * (train_info->station_count - 1);
+  auto vacancy = vacancy_vls_->Allocate<Vacancy>(vacancy_size);
+  train_info->vacancy_id = vacancy.RecordID();
+  std::fill_n(vacancy->vacancy, vacancy_size, train_info->seat_count);
+  // 2. Add the train to the station's train list, sorted so that stations sharing a leaf share the descent
+  using StationTrain = std::pair<storage::PackedPair<storage::record_id_t, storage::record_id_t>, storage::NoValue>;
+  std::vector<StationTrain> station_trains;
+  station_trains.reserve(train_info->station_count);
+  station_trains.emplace_back(storage::make_packed_pair(train_info->depart_station, train_id), storage::NoValue{});
   for (int i = 0; i < train_info->station_count - 1; ++i) {
-    station_train_index_.Insert({train_info->station[i].station_id, train_id},
-                                'a');
+    station_trains.emplace_back(
+        storage::make_packed_pair(train_info->station[i].station_id, train_id), storage::NoValue{});
   }
+  storage::sort(station_trains.begin(), station_trains.end());
+  station_train_index_.InsertBatch(station_trains);
   utils::FastIO::WriteSuccess();
 }
 void TrainManager::QueryTrain(std::string_view train_name, date_t date) {
@@ -212,9 +216,9 @@ void TrainManager::QueryTrain(std::string_view train_name, date_t date) {
   utils::FastIO::Write(train_name, ' ', train_info->type, '\n');
   // 2. Output the station information
   bool released = train_info->IsReleased();
-  storage::VarLengthStore::Handle<Vacancy> vacancy_handle;
+  VacancyStore::Handle<Vacancy> vacancy_handle;
   if (released) {
-    vacancy_handle = vls_->Get<Vacancy>(train_info->GetVacancyId(date));
+    vacancy_handle = vacancy_vls_->Get<Vacancy>(train_info->vacancy_id);
   }
   const Vacancy* vacancy = released ? vacancy_handle.Get() : nullptr;
   for (int8_t i = 0; i < train_info->station_count; ++i) {
@@ -225,7 +229,7 @@ void TrainManager::QueryTrain(std::string_view train_name, date_t date) {
     int price = train_info->GetPrice(i);
     int seat = train_info->seat_count;
     if (released && i != train_info->station_count - 1) {
-      seat = vacancy->GetVacancy(train_info->station_count, date, i);
+      seat = vacancy->GetVacancy(train_info->station_count, train_info->date_beg, date, i);
     }
     utils::FastIO::Write(utils::get_field(station_name->name, 30), ' ',
                          utils::Parser::DateTimeString(arrive_time), " -> ",
@@ -464,10 +468,9 @@ void TrainManager::PrintTicket(storage::record_id_t train_id,
   auto price = train->GetPrice(from_station_no, to_station_no);
   auto seat = train->seat_count;
   if (train->IsReleased()) {
-    auto vacancy_handle = vls_->Get<Vacancy>(
-        train->GetVacancyId(depart_date));
+    auto vacancy_handle = vacancy_vls_->Get<Vacancy>(train->vacancy_id);
     seat = vacancy_handle.Get()->
-        GetVacancy(train->station_count, depart_date,
+        GetVacancy(train->station_count, train->date_beg, depart_date,
                    from_station_no, to_station_no);
   }
   utils::FastIO::Write(utils::get_field(train->train_name, 20), ' ',
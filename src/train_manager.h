@@ -21,7 +21,7 @@ struct TrainInfo {
   date_t date_beg;
   date_t date_end;
   storage::record_id_t depart_station;
-  storage::record_id_t vacancy_id[DATE_BATCH_COUNT];
+  storage::record_id_t vacancy_id; // in the vacancy store, INVALID_RECORD_ID until the train is released
 
   struct Station {
     DELETE_CONSTRUCTOR_AND_DESTRUCTOR(Station);
@@ -38,8 +38,6 @@ struct TrainInfo {
 
   bool IsOnSale(date_t date) const { return date >= date_beg && date <= date_end; }
 
-  storage::record_id_t GetVacancyId(date_t date) const { return vacancy_id[date / DATE_BATCH_SIZE]; }
-
   storage::record_id_t GetStationId(int station_no) const;
 
   int GetStationNo(storage::record_id_t station_id) const;
@@ -61,22 +59,23 @@ struct TrainInfo {
   date_t GetDepartDate(date_t leaving_date, int leaving_station) const;
 };
 
-// Vacacy information of one service of a train
+// Vacancy information of all the services of a train, one row of `station_count - 1` seats per day on sale.
+// The methods take the departing date of the service, and `date_beg` of the train.
 struct Vacancy {
   DELETE_CONSTRUCTOR_AND_DESTRUCTOR(Vacancy);
-  int vacancy[0]; // Its size is equal to the `station count - 1`of the train
+  int vacancy[0]; // Its size is `(date_end - date_beg + 1) * (station_count - 1)`
   using data_t = int;
   using zero_base_size = std::true_type;
 
-  int GetVacancy(int8_t station_count, date_t date, int station_no) const;
+  int GetVacancy(int8_t station_count, date_t date_beg, date_t date, int station_no) const;
 
-  const int *GetVacancy(int8_t station_count, date_t date) const;
+  const int *GetVacancy(int8_t station_count, date_t date_beg, date_t date) const;
 
-  int *GetVacancy(int8_t station_count, date_t date);
+  int *GetVacancy(int8_t station_count, date_t date_beg, date_t date);
 
-  int GetVacancy(int8_t station_count, date_t date, int from, int to) const;
+  int GetVacancy(int8_t station_count, date_t date_beg, date_t date, int from, int to) const;
 
-  void ReduceVacancy(int8_t station_count, date_t date, int from, int to, int num);
+  void ReduceVacancy(int8_t station_count, date_t date_beg, date_t date, int from, int to, int num);
 };
 
 struct StationName {
@@ -86,14 +85,18 @@ struct StationName {
   using zero_base_size = std::true_type;
 };
 
+using VacancyStore = storage::VarLengthStore<storage::VLS_VACANCY_PAGES_PER_FRAME>;
+
 class TrainManager {
   public:
     TrainManager(storage::BufferPoolManager<storage::BPT_PAGES_PER_FRAME> *bpm,
-                 storage::VarLengthStore *vls,
-                 bool reset) : vls_(vls),
+                 storage::BufferPoolManager<storage::BPT_SCAN_PAGES_PER_FRAME> *scan_bpm,
+                 storage::VarLengthStore<> *vls,
+                 VacancyStore *vacancy_vls,
+                 bool reset) : vls_(vls), vacancy_vls_(vacancy_vls),
                                train_id_index_(bpm, bpm->AllocateInfo(), reset),
                                station_id_index_(bpm, bpm->AllocateInfo(), reset),
-                               station_train_index_(bpm, bpm->AllocateInfo(), reset) {
+                               station_train_index_(scan_bpm, scan_bpm->AllocateInfo(), reset) {
     }
 
     void AddTrain(std::string_view train_name,
@@ -127,13 +130,15 @@ class TrainManager {
     );
 
   private:
-    storage::VarLengthStore *vls_; // stores TrainInfo, Vacancy, and StationName
+    storage::VarLengthStore<> *vls_; // stores TrainInfo and StationName
+    VacancyStore *vacancy_vls_; // stores Vacancy
   protected:
     storage::BPlusTree<storage::hash_t, storage::record_id_t> train_id_index_;
     storage::BPlusTree<storage::hash_t, storage::record_id_t> station_id_index_;
     storage::BPlusTree<
-      storage::PackedPair<storage::record_id_t, storage::record_id_t>, char> station_train_index_;
-    // station -> trains passing by. The value char is not used
+      storage::PackedPair<storage::record_id_t, storage::record_id_t>, storage::NoValue,
+      storage::BPT_INTERNAL_LAYOUT, storage::BPT_SCAN_PAGES_PER_FRAME> station_train_index_;
+    // station -> trains passing by, a set of keys
 
     storage::record_id_t GetStationId(std::string_view station_name); // Will create a new station if not found
 
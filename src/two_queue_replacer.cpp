@@ -0,0 +1,85 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#include "two_queue_replacer.h"
+
+namespace storage {
+TwoQueueReplacer::TwoQueueReplacer(size_t pool_size) : in_capacity_(static_cast<int>(pool_size * TWO_Q_IN_RATIO)),
+                                                       lists_(static_cast<int>(pool_size), 2),
+                                                       evictable_(pool_size, 0),
+                                                       pages_(pool_size, INVALID_PAGE_ID),
+                                                       a1out_(static_cast<size_t>(pool_size * TWO_Q_OUT_RATIO)) {
+}
+auto TwoQueueReplacer::Evict(frame_id_t *frame_id) -> bool {
+  if (size_ == 0) {
+    return false;
+  }
+  int list = lists_.Size(kA1in) > in_capacity_ ? kA1in : kAm;
+  frame_id_t victim = FirstEvictable(list);
+  if (victim == IntrusiveLists::kNone) {
+    list = 1 - list;
+    victim = FirstEvictable(list);
+  }
+  if (list == kA1in) {
+    a1out_.Push(pages_[victim]);
+  }
+  Remove(victim);
+  *frame_id = victim;
+  return true;
+}
+auto TwoQueueReplacer::RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void {
+  if (lists_.Contains(frame_id)) {
+    if (lists_.ListOf(frame_id) == kAm) {
+      lists_.Erase(frame_id);
+      lists_.PushBack(kAm, frame_id);
+    }
+    return;
+  }
+  pages_[frame_id] = page_id;
+  lists_.PushBack(a1out_.Erase(page_id) ? kAm : kA1in, frame_id);
+}
+void TwoQueueReplacer::SetEvictable(frame_id_t frame_id) {
+  if (!evictable_[frame_id]) {
+    evictable_[frame_id] = 1;
+    ++size_;
+  }
+  if (lists_.Contains(frame_id) && lists_.Parked(frame_id)) {
+    lists_.Unpark(frame_id);
+  }
+}
+void TwoQueueReplacer::SetNonevictable(frame_id_t frame_id) {
+  if (evictable_[frame_id]) {
+    evictable_[frame_id] = 0;
+    --size_;
+  }
+}
+void TwoQueueReplacer::Remove(frame_id_t frame_id) {
+  SetNonevictable(frame_id);
+  if (lists_.Contains(frame_id)) {
+    lists_.Erase(frame_id);
+  }
+}
+auto TwoQueueReplacer::Size() const -> size_t {
+  return size_;
+}
+void TwoQueueReplacer::Coldest(size_t n, std::vector<frame_id_t> *frames) const {
+  for (int list : {kA1in, kAm}) {
+    for (frame_id_t it = lists_.Front(list); it != IntrusiveLists::kNone && n > 0; it = lists_.Next(it)) {
+      if (evictable_[it]) {
+        frames->push_back(it);
+        --n;
+      }
+    }
+  }
+}
+auto TwoQueueReplacer::FirstEvictable(int list) -> frame_id_t {
+  // a pinned frame met at the front is parked until it is unpinned, so that no evict passes it again
+  frame_id_t it = lists_.Front(list);
+  while (it != IntrusiveLists::kNone && !evictable_[it]) {
+    lists_.Park(it);
+    it = lists_.Front(list);
+  }
+  return it;
+}
+} // namespace storage
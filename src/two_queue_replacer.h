@@ -0,0 +1,54 @@
+//
+// Created by zj on 6/4/2024.
+//
+
+#pragma once
+#include <config.h>
+#include <cstdint>
+#include <vector>
+
+#include "replacer_lists.h"
+
+namespace storage {
+/**
+ * @brief 2Q replacement (Johnson & Shasha, full version).
+ *
+ * A page cached for the first time enters A1in, a FIFO that re-references do not reorder, so a scan passes
+ * through it without touching the hot pages. Pages evicted from A1in are remembered in the ghost FIFO A1out;
+ * a page missed while in A1out has proven to be reused and is cached in Am, an LRU list.
+ * A1in is evicted from while it holds more than `TWO_Q_IN_RATIO` of the pool, Am otherwise.
+ * A frame that is still pinned when it comes up for eviction is parked, and rejoins the end of its queue once unpinned.
+ */
+class TwoQueueReplacer {
+  public:
+    using frame_id_t = int;
+    explicit TwoQueueReplacer(size_t pool_size);
+
+    auto Evict(frame_id_t *frame_id) -> bool;
+
+    auto RecordAccess(frame_id_t frame_id, page_id_t page_id) -> void;
+
+    void SetEvictable(frame_id_t frame_id);
+
+    void SetNonevictable(frame_id_t frame_id);
+
+    void Remove(frame_id_t frame_id);
+
+    auto Size() const -> size_t;
+
+    /// @brief Append up to `n` evictable frames, roughly in the order they would be evicted
+    void Coldest(size_t n, std::vector<frame_id_t> *frames) const;
+
+  private:
+    static constexpr int kA1in = 0;
+    static constexpr int kAm = 1;
+    const int in_capacity_;
+    size_t size_ = 0;
+    IntrusiveLists lists_; // every cached frame, oldest first; pinned ones may be parked, see FirstEvictable
+    std::vector<uint8_t> evictable_;
+    std::vector<page_id_t> pages_;
+    GhostList a1out_;
+
+    auto FirstEvictable(int list) -> frame_id_t;
+};
+} // namespace storage
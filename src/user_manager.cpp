@@ -9,10 +9,14 @@
 
 namespace business {
 UserManager::~UserManager() {
-  for (const auto &[_, user] : logged_in_users_) {
+  WriteBackOrderCounts();
+}
+void UserManager::WriteBackOrderCounts() {
+  for (auto &[_, user] : logged_in_users_) {
     if (user.order_count != user.original_order_count) {
       auto handle = vls_->Get<UserProfile>(user.user_id);
       handle->order_count = user.order_count;
+      user.original_order_count = user.order_count;
     }
   }
 }
@@ -31,6 +35,7 @@ void UserManager::AddUser(std::string_view cur_user,
   auto username_hash = storage::Hash()(username);
   auto handle = vls_->Allocate<UserProfile>();
   if (user_id_index_.Insert(username_hash, handle.RecordID()) == false) {
+    vls_->Free<UserProfile>(handle.RecordID());
     return utils::FastIO::WriteFailure();
   }
   handle->password = storage::Hash()(password);
@@ -32,7 +32,7 @@ struct UserData {
 class UserManager {
   public:
     UserManager(storage::BufferPoolManager<storage::BPT_PAGES_PER_FRAME> *bpm,
-                storage::VarLengthStore *vls,
+                storage::VarLengthStore<> *vls,
                 bool reset) : vls_(vls), user_id_index_(bpm, bpm->AllocateInfo(), reset) {
     }
 
@@ -56,7 +56,7 @@ class UserManager {
                        int8_t privilege);
 
   private:
-    storage::VarLengthStore *vls_; // stores UserProfile
+    storage::VarLengthStore<> *vls_; // stores UserProfile
 
   protected:
     std::unordered_map<storage::hash_t, UserData> logged_in_users_{};
@@ -66,5 +66,7 @@ class UserManager {
     int8_t GetLoggedInUserPrivilege(std::string_view username);
     auto GetLoggedInUser(storage::hash_t username) -> decltype(logged_in_users_.find({}));
     auto GetLoggedInUser(std::string_view username) -> decltype(logged_in_users_.find({}));
+    /// @brief Write the order counts of the logged-in users to their profiles, so that a commit covers them
+    void WriteBackOrderCounts();
 };
 } // namespace business
@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <algorithm>
 #include <bit>
 #include <iterator>
+#include <type_traits>
 
 namespace storage {
 #pragma pack(push, 1)
@@ -20,6 +22,17 @@ struct PackedPair {
 };
 #pragma pack(pop)
 
+template<typename T>
+struct IsPackedPair : std::false_type {};
+template<typename T1, typename T2>
+struct IsPackedPair<PackedPair<T1, T2> > : std::true_type {};
+
+/// Value type of a B+ tree used as a set of keys; its leaves store keys only, see `BPlusTreeLeafFrame`
+struct NoValue {
+  bool operator ==(const NoValue &) const = default;
+  auto operator <=>(const NoValue &) const = default;
+};
+
 template<typename T1, typename T2>
 auto make_packed_pair(const T1 &first, const T2 &second) {
   return PackedPair<T1, T2>{first, second};
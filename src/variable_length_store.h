@@ -6,6 +6,8 @@
 
 #include <config.h>
 
+#include <bit>
+#include <cstring>
 #include <utility>
 
 #include "buffer_pool_manager.h"
@@ -18,23 +20,48 @@ concept var_length_object = requires(T t) { typename T::data_t; };
 template<class T>
 concept var_length_array = var_length_object<T> && requires(T t) { T::zero_base_size; };
 
+/**
+ * @brief Stores variable-length records in frames of `PagesPerFrame` pages; a record never spans two frames, so a
+ * store of records up to n pages long needs frames of n pages, see `VLS_VACANCY_PAGES_PER_FRAME`.
+ *
+ * Records are carved from the end of the last frame (`top_pos_`), or taken from free lists. A freed record becomes
+ * a free block, which holds the next block of its list and its own size. Blocks are kept in size classes: class c
+ * holds the blocks of `kMinBlockSize << c` up to twice that many bytes. An allocation takes the head of the first
+ * class whose blocks all fit it, or the head of its own class if that one fits, and frees what it leaves of the
+ * block. The list heads and the byte counts live in the info page, so that they persist. Blocks are never merged:
+ * `GarbageRatio` tells when the store is worth compacting, see `business::TicketSystem::Compact`.
+ */
+template<int PagesPerFrame = VLS_PAGES_PER_FRAME>
 class VarLengthStore {
   public:
-    static constexpr int PagesPerFrame = VLS_PAGES_PER_FRAME;
     using length_t = int32_t;
-    static constexpr int kFrameSize = Frame<PagesPerFrame>::kFrameSize;
+    static constexpr int kFrameSize = Frame<PagesPerFrame>::kDataSize; // record ids count these bytes of a frame
     using BasicFrameGuard = BufferPoolManager<PagesPerFrame>::BasicFrameGuard;
 
     template<var_length_object T>
     class Handle;
 
-    explicit VarLengthStore(BufferPoolManager<PagesPerFrame> *bpm, record_id_t &top_pos, bool reset = false) : bpm_(bpm), top_pos_(top_pos) {
-      if (reset) top_pos = 0;
+    explicit VarLengthStore(BufferPoolManager<PagesPerFrame> *bpm, record_id_t &top_pos, bool reset = false)
+      : bpm_(bpm), top_pos_(top_pos), used_bytes_(bpm->AllocateInfo()), free_bytes_(bpm->AllocateInfo()) {
+      for (auto &head : free_heads_) head = &bpm->AllocateInfo();
+      if (!reset) return;
+      top_pos = 0;
+      used_bytes_ = free_bytes_ = 0;
+      for (auto head : free_heads_) *head = INVALID_RECORD_ID;
     }
 
     template<var_length_object T>
     auto Allocate(length_t n = 0) -> Handle<T>;
 
+    /// @brief Free the record at `pos`, allocated by `Allocate<T>(n)`; records below `kMinBlockSize` bytes are lost
+    template<var_length_object T>
+    void Free(const record_id_t &pos, length_t n = 0);
+
+    /// @return The share of the store that is free blocks, 0 for an empty store
+    auto GarbageRatio() const -> double {
+      return used_bytes_ + free_bytes_ == 0 ? 0 : static_cast<double>(free_bytes_) / (used_bytes_ + free_bytes_);
+    }
+
     template<var_length_object T>
     auto Get(const record_id_t &pos) -> Handle<T>;
 
@@ -71,20 +98,72 @@ class VarLengthStore {
     };
 
   private:
+    struct FreeBlock {
+      record_id_t next;
+      length_t size;
+    };
+    static constexpr length_t kMinBlockSize = sizeof(FreeBlock);
+    static constexpr int kClasses = std::bit_width(static_cast<unsigned>(kFrameSize / kMinBlockSize));
+
     BufferPoolManager<PagesPerFrame> *bpm_;
     record_id_t &top_pos_;
+    int &used_bytes_; // in live records
+    int &free_bytes_; // in free blocks
+    int *free_heads_[kClasses]; // by size class, INVALID_RECORD_ID if empty
 
     static auto GetPageId(const record_id_t &pos) -> page_id_t { return pos / kFrameSize; }
 
     static auto GetRemainingSize(const record_id_t &pos) -> length_t { return (kFrameSize - pos % kFrameSize) % kFrameSize; }
+
+    static auto ClassOf(length_t size) -> int { return std::bit_width(static_cast<unsigned>(size / kMinBlockSize)) - 1; }
+
+    /// @brief Pop a free block of at least `size` bytes and free its rest; INVALID_RECORD_ID if there is none
+    auto TakeFree(length_t size, BasicFrameGuard *guard) -> record_id_t;
+
+    /// @brief Put the `size` bytes at `pos`, in the frame of `guard`, on their free list
+    void PushFree(BasicFrameGuard &guard, record_id_t pos, length_t size);
 };
+template<int PagesPerFrame>
+auto VarLengthStore<PagesPerFrame>::TakeFree(length_t size, BasicFrameGuard *guard) -> record_id_t {
+  for (int c = ClassOf(size); c < kClasses; ++c) {
+    record_id_t pos = *free_heads_[c];
+    if (pos == INVALID_RECORD_ID) continue;
+    *guard = bpm_->FetchFrameBasic(GetPageId(pos));
+    FreeBlock block;
+    std::memcpy(&block, guard->GetData() + pos % kFrameSize, sizeof(FreeBlock));
+    if (block.size < size) continue; // only the head of the first class may be too small
+    *free_heads_[c] = block.next;
+    free_bytes_ -= block.size;
+    if (block.size - size >= kMinBlockSize) PushFree(*guard, pos + size, block.size - size);
+    return pos;
+  }
+  return INVALID_RECORD_ID;
+}
+template<int PagesPerFrame>
+void VarLengthStore<PagesPerFrame>::PushFree(BasicFrameGuard &guard, record_id_t pos, length_t size) {
+  auto &head = *free_heads_[ClassOf(size)];
+  FreeBlock block{head, size};
+  std::memcpy(guard.GetDataMut() + pos % kFrameSize, &block, sizeof(FreeBlock));
+  head = pos;
+  free_bytes_ += size;
+}
+template<int PagesPerFrame>
 template<var_length_object T>
-auto VarLengthStore::Allocate(length_t n) -> Handle<T> {
+auto VarLengthStore<PagesPerFrame>::Allocate(length_t n) -> Handle<T> {
   auto object_size = GetObjectSize<T>(n);
   ASSERT(object_size <= kFrameSize);
-  auto remaining_size = GetRemainingSize(top_pos_);
+  used_bytes_ += object_size;
   BasicFrameGuard guard;
+  if (object_size >= kMinBlockSize) {
+    if (auto pos = TakeFree(object_size, &guard); pos != INVALID_RECORD_ID) return Handle<T>(guard, pos);
+  }
+  auto remaining_size = GetRemainingSize(top_pos_);
   if (remaining_size < object_size) {
+    if (remaining_size >= kMinBlockSize) {
+      // the tail of the last frame is left to the free lists
+      guard = bpm_->FetchFrameBasic(GetPageId(top_pos_));
+      PushFree(guard, top_pos_, remaining_size);
+    }
     // Allocate a new frame from bpm
     guard = bpm_->NewFrameGuarded();
     top_pos_ = guard.PageId() * kFrameSize;
@@ -95,8 +174,19 @@ auto VarLengthStore::Allocate(length_t n) -> Handle<T> {
   top_pos_ += object_size;
   return ret;
 }
+template<int PagesPerFrame>
+template<var_length_object T>
+void VarLengthStore<PagesPerFrame>::Free(const record_id_t &pos, length_t n) {
+  ASSERT(pos != INVALID_RECORD_ID);
+  auto object_size = GetObjectSize<T>(n);
+  used_bytes_ -= object_size;
+  if (object_size < kMinBlockSize) return;
+  auto guard = bpm_->FetchFrameBasic(GetPageId(pos));
+  PushFree(guard, pos, object_size);
+}
+template<int PagesPerFrame>
 template<var_length_object T>
-auto VarLengthStore::Get(const record_id_t &pos) -> Handle<T> {
+auto VarLengthStore<PagesPerFrame>::Get(const record_id_t &pos) -> Handle<T> {
 	ASSERT(pos != INVALID_RECORD_ID);
   auto page_id = GetPageId(pos);
   auto offset = pos % kFrameSize;
@@ -0,0 +1,193 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#include "write_ahead_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include "hash.h"
+
+namespace storage {
+namespace {
+/// @return The content of a log file, empty if there is none
+auto ReadLog(const std::string &file_name) -> std::vector<char> {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return {};
+  std::vector<char> log(lseek(fd, 0, SEEK_END));
+  bool read = pread(fd, log.data(), log.size(), 0) == static_cast<ssize_t>(log.size());
+  close(fd);
+  if (!read) {
+    throw std::runtime_error("Cannot read file " + file_name);
+  }
+  return log;
+}
+} // namespace
+WriteAheadLog::WriteAheadLog(std::string file_name, bool reset) : file_name_(std::move(file_name)) {
+  if (reset) unlink((file_name_ + kOldSuffix).c_str());
+  fd_ = open(file_name_.c_str(), O_RDWR | O_CREAT | (reset ? O_TRUNC : 0), 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Cannot open file " + file_name_);
+  }
+  size_ = lseek(fd_, 0, SEEK_END);
+  group_begin_ = checkpoint_begin_ = Clock::now();
+}
+WriteAheadLog::~WriteAheadLog() {
+  close(fd_);
+  // an empty log is a clean shutdown, leave no file behind
+  if (size_ == 0 && group_.empty()) unlink(file_name_.c_str());
+}
+auto WriteAheadLog::Attach(LogTarget *target) -> int {
+  targets_.push_back(target);
+  return static_cast<int>(targets_.size()) - 1;
+}
+void WriteAheadLog::Recover() {
+  // the log moved aside by a checkpoint that did not finish comes first
+  std::vector<char> logs[] = {ReadLog(file_name_ + kOldSuffix), ReadLog(file_name_)};
+  // the latest committed frames and info page of every file
+  std::vector<std::unordered_map<page_id_t, const char *> > frames(targets_.size());
+  std::vector<const char *> infos(targets_.size(), nullptr);
+  for (const auto &log : logs) {
+    std::vector<std::pair<uint64_t, const char *> > group; // records since the last commit
+    size_t group_begin = 0;
+    RecordHeader header;
+    for (size_t pos = 0; pos + sizeof(RecordHeader) <= log.size(); pos += sizeof(RecordHeader) + header.size) {
+      memcpy(&header, log.data() + pos, sizeof(RecordHeader));
+      if (pos + sizeof(RecordHeader) + header.size > log.size() || header.file_id < -1
+          || header.file_id >= static_cast<int>(targets_.size())) {
+        break; // torn
+      }
+      const char *data = log.data() + pos + sizeof(RecordHeader);
+      if (header.type != RecordType::COMMIT) {
+        if (header.file_id < 0) break;
+        group.emplace_back(Key(header.file_id, header.type == RecordType::INFO ? INVALID_PAGE_ID : header.page_id),
+                           data);
+        continue;
+      }
+      hash_t hash;
+      memcpy(&hash, data, sizeof(hash_t));
+      if (header.size != sizeof(hash_t)
+          || hash != Hash()(std::string_view(log.data() + group_begin, pos - group_begin))) {
+        break; // the commit record made it to the disk, but not all of its group
+      }
+      for (auto [key, frame] : group) {
+        int file_id = static_cast<int>(key >> 32);
+        auto page_id = static_cast<page_id_t>(key);
+        if (page_id == INVALID_PAGE_ID) {
+          infos[file_id] = frame;
+        } else {
+          frames[file_id][page_id] = frame;
+        }
+      }
+      group.clear();
+      group_begin = pos + sizeof(RecordHeader) + header.size;
+    }
+  }
+  for (size_t file_id = 0; file_id < targets_.size(); ++file_id) {
+    // the info page first, it tells how many frames the file has
+    if (infos[file_id] != nullptr) targets_[file_id]->ApplyInfo(infos[file_id]);
+    for (auto [page_id, frame] : frames[file_id]) {
+      targets_[file_id]->ApplyFrame(page_id, frame);
+    }
+  }
+  Checkpoint();
+}
+void WriteAheadLog::Append(int file_id, page_id_t page_id, const char *data) {
+  auto [it, inserted] = frames_.try_emplace(Key(file_id, page_id), 0);
+  if (!inserted) {
+    // the group is written as a whole, so the frame can be overwritten in place
+    memcpy(group_.data() + it->second, data, targets_[file_id]->FrameSize());
+    return;
+  }
+  it->second = AppendRecord(RecordType::FRAME, file_id, page_id, data, targets_[file_id]->FrameSize());
+}
+auto WriteAheadLog::Find(int file_id, page_id_t page_id) const -> const char * {
+  if (frames_.empty()) return nullptr;
+  auto it = frames_.find(Key(file_id, page_id));
+  return it == frames_.end() ? nullptr : group_.data() + it->second;
+}
+auto WriteAheadLog::CommandDone() -> bool {
+  if (commands_++ == 0) group_begin_ = Clock::now();
+  return commands_ >= WAL_GROUP_COMMANDS
+         || Clock::now() - group_begin_ >= std::chrono::milliseconds(WAL_GROUP_INTERVAL_MS);
+}
+void WriteAheadLog::Commit(bool force) {
+  commands_ = 0;
+  if (group_.empty() && !force) return; // nothing was written back
+  for (size_t file_id = 0; file_id < targets_.size(); ++file_id) {
+    AppendRecord(RecordType::INFO, static_cast<int>(file_id), INVALID_PAGE_ID, targets_[file_id]->InfoData(),
+                 PAGE_SIZE);
+  }
+  hash_t hash = Hash()(std::string_view(group_.data(), group_.size()));
+  AppendRecord(RecordType::COMMIT, -1, INVALID_PAGE_ID, reinterpret_cast<const char *>(&hash), sizeof(hash_t));
+  if (pwrite(fd_, group_.data(), group_.size(), size_) != static_cast<ssize_t>(group_.size())
+      || fdatasync(fd_) != 0) {
+    throw std::runtime_error("Cannot write file " + file_name_);
+  }
+  size_ += group_.size();
+  for (auto [key, offset] : frames_) {
+    targets_[key >> 32]->ApplyFrame(static_cast<page_id_t>(key), group_.data() + offset);
+  }
+  for (auto target : targets_) target->ApplyInfo(target->InfoData());
+  group_.clear();
+  frames_.clear();
+  if (checkpointing_) {
+    FinishCheckpoint(); // the kernel had a whole group's time to write the db files back
+  } else if (size_ >= WAL_CHECKPOINT_SIZE
+             || Clock::now() - checkpoint_begin_ >= std::chrono::milliseconds(WAL_CHECKPOINT_INTERVAL_MS)) {
+    BeginCheckpoint();
+  }
+}
+void WriteAheadLog::Checkpoint() {
+  std::string old_file_name = file_name_ + kOldSuffix;
+  bool old = access(old_file_name.c_str(), F_OK) == 0;
+  if (size_ == 0 && !old) return;
+  SyncTargets();
+  if (old) unlink(old_file_name.c_str());
+  checkpointing_ = false;
+  if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+    throw std::runtime_error("Cannot truncate file " + file_name_);
+  }
+  size_ = 0;
+  checkpoint_begin_ = Clock::now();
+}
+void WriteAheadLog::BeginCheckpoint() {
+  // every group in the log is applied already, so the log is only needed until the db files are synced
+  std::string old_file_name = file_name_ + kOldSuffix;
+  close(fd_);
+  if (rename(file_name_.c_str(), old_file_name.c_str()) != 0) {
+    throw std::runtime_error("Cannot rename file " + file_name_);
+  }
+  fd_ = open(file_name_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Cannot open file " + file_name_);
+  }
+  size_ = 0;
+  checkpoint_begin_ = Clock::now();
+  checkpointing_ = true;
+  for (auto target : targets_) target->StartSync();
+}
+void WriteAheadLog::FinishCheckpoint() {
+  SyncTargets();
+  unlink((file_name_ + kOldSuffix).c_str());
+  checkpointing_ = false;
+}
+void WriteAheadLog::SyncTargets() {
+  for (auto target : targets_) target->SyncFile();
+}
+auto WriteAheadLog::AppendRecord(RecordType type, int file_id, page_id_t page_id, const char *data, size_t size)
+  -> size_t {
+  RecordHeader header{type, file_id, page_id, static_cast<uint32_t>(size)};
+  size_t pos = group_.size();
+  group_.resize(pos + sizeof(RecordHeader) + size);
+  memcpy(group_.data() + pos, &header, sizeof(RecordHeader));
+  memcpy(group_.data() + pos + sizeof(RecordHeader), data, size);
+  return pos + sizeof(RecordHeader);
+}
+} // namespace storage
@@ -0,0 +1,114 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+#pragma once
+
+#include <config.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace storage {
+/// @brief A db file whose frames are written through a `WriteAheadLog`, see `DiskManager::AttachLog`
+class LogTarget {
+  public:
+    virtual ~LogTarget() = default;
+    virtual auto FrameSize() const -> size_t = 0;
+    /// @brief The info page as it is to be committed, PAGE_SIZE bytes
+    virtual auto InfoData() -> const char * = 0;
+    /// @brief Write a committed frame to the db file
+    virtual void ApplyFrame(page_id_t page_id, const char *data) = 0;
+    /// @brief Take a committed info page over, and write it to the db file
+    virtual void ApplyInfo(const char *info) = 0;
+    /// @brief Start writing back everything applied so far, without waiting for it; throws if it cannot be started
+    virtual void StartSync() = 0;
+    /// @brief Make everything applied so far durable
+    virtual void SyncFile() = 0;
+};
+
+/**
+ * @brief A redo log of frame images, shared by the db files of a ticket system so that they commit together.
+ *
+ * Frames written back between two commits are kept in memory, in the current group, and served from there to
+ * later reads: the db files only ever hold committed frames. `Commit` appends the info page of every file and a
+ * commit record, which carries a hash of the group, writes the group to the log in one go and syncs it once, and
+ * only then applies the group to the db files. Commits are grouped over many commands: `CommandDone` tells when
+ * a group is due, after `WAL_GROUP_COMMANDS` commands or `WAL_GROUP_INTERVAL_MS`.
+ *
+ * Checkpoints are fuzzy. Once the log outgrows `WAL_CHECKPOINT_SIZE` or `WAL_CHECKPOINT_INTERVAL_MS` has passed,
+ * a commit moves the log aside, starts a new one and has the kernel write the db files back; the next commit syncs
+ * them, by then mostly written, and deletes the old log. As the db files never see an uncommitted frame, the
+ * groups of the old log are all applied already, and once synced nothing before the new log is needed. A restart
+ * thus replays at most two logs of bounded size. No thread is involved: a second thread alone makes every malloc
+ * of the process take a lock.
+ *
+ * `Recover` applies the committed groups of the logs left by a crash; a group whose commit record is missing or
+ * does not match the hash is dropped. `Checkpoint` syncs and empties the logs in place, which happens after a
+ * recovery and on shutdown.
+ */
+class WriteAheadLog {
+  public:
+    WriteAheadLog(std::string file_name, bool reset);
+    ~WriteAheadLog();
+
+    /// @return The id of the file in the log records
+    auto Attach(LogTarget *target) -> int;
+    /// @brief Apply the committed groups to the attached files, then checkpoint; call once all files are attached
+    void Recover();
+
+    /// @brief Add a frame to the current group
+    void Append(int file_id, page_id_t page_id, const char *data);
+    /// @return The frame as last appended to the current group, nullptr if it is not there
+    auto Find(int file_id, page_id_t page_id) const -> const char *;
+
+    /// @brief Count a command towards the current group, and tell whether the group is due
+    auto CommandDone() -> bool;
+    /**
+     * @brief Commit the current group; the frames of the attached files must have been written back.
+     * @param force commit the info pages even if no frame was written back, as after a reset
+     */
+    void Commit(bool force = false);
+    /// @brief Sync the db files and empty the logs
+    void Checkpoint();
+
+  private:
+    enum class RecordType : uint32_t {
+      FRAME = 0,
+      INFO = 1,
+      COMMIT = 2, // its data is the hash of the records of the group
+    };
+    struct RecordHeader {
+      RecordType type;
+      int32_t file_id;
+      page_id_t page_id;
+      uint32_t size; // of the data that follows
+    };
+    using Clock = std::chrono::steady_clock;
+    static constexpr char kOldSuffix[] = ".old"; // the log behind a checkpoint in progress
+
+    std::string file_name_;
+    int fd_ = -1;
+    size_t size_ = 0; // of the log file
+    std::vector<LogTarget *> targets_;
+    std::vector<char> group_; // records of the current group
+    std::unordered_map<uint64_t, size_t> frames_; // latest frame of (file id, page id) in `group_`, at its data
+    int commands_ = 0; // in the current group
+    Clock::time_point group_begin_;
+    Clock::time_point checkpoint_begin_; // of the last checkpoint
+    bool checkpointing_ = false; // whether the old log waits for the db files to be synced
+
+    static auto Key(int file_id, page_id_t page_id) -> uint64_t {
+      return static_cast<uint64_t>(file_id) << 32 | static_cast<uint32_t>(page_id);
+    }
+    auto AppendRecord(RecordType type, int file_id, page_id_t page_id, const char *data, size_t size) -> size_t;
+    /// @brief Move the log aside and start writing the db files back
+    void BeginCheckpoint();
+    /// @brief Sync the db files and delete the old log
+    void FinishCheckpoint();
+    void SyncTargets();
+};
+} // namespace storage
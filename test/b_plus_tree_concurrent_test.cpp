@@ -0,0 +1,134 @@
+//
+// Created by zj on 6/7/2024.
+//
+
+// Writers and scanning readers share a concurrent BPlusTree. Each writer owns the keys of its residue modulo
+// kWriters and mirrors them in a std::map; readers check that every scan is ordered and sees consistent values.
+// At the end the tree must hold exactly the union of the maps and pass Validate.
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "b_plus_tree.h"
+
+namespace {
+using storage::hash_t;
+
+constexpr int kWriters = 4;
+constexpr int kReaders = 3;
+constexpr int kOperations = 60000; // per writer
+constexpr hash_t kKeysPerWriter = 4000;
+constexpr size_t kPoolSize = 64; // small, so that frames are evicted and fetched again under the readers
+
+auto ValueOf(hash_t key) -> int { return static_cast<int>(key * 31 % 1000003); }
+
+auto Run(int pinned_levels, bool cleaner) -> bool {
+  storage::BufferPoolManager<1> bpm("b_plus_tree_concurrent_test.db", true, kPoolSize,
+                                    storage::BufferPoolMode::COPY, cleaner, true);
+  storage::page_id_t root_page_id = storage::INVALID_PAGE_ID;
+  storage::BPlusTree<hash_t, int> bpt(&bpm, root_page_id, true, pinned_levels, true);
+  std::atomic<bool> failed = false, done = false;
+  auto fail = [&](const char *what) {
+    std::printf("pinned levels %d, cleaner %d: %s\n", pinned_levels, cleaner, what);
+    failed = true;
+  };
+
+  std::vector<std::map<hash_t, int> > expected(kWriters);
+  std::vector<std::thread> threads;
+  for (int w = 0; w < kWriters; ++w) {
+    threads.emplace_back([&, w] {
+      std::mt19937_64 rng(w);
+      auto &map = expected[w];
+      auto next_key = [&] { return rng() % kKeysPerWriter * kWriters + w; };
+      for (int i = 0; i < kOperations && !failed; ++i) {
+        auto key = next_key();
+        auto op = rng() % 10;
+        if (op < 4) {
+          if (bpt.Insert(key, ValueOf(key)) != map.emplace(key, ValueOf(key)).second) fail("Insert");
+        } else if (op < 7) {
+          if (bpt.Remove(key) != static_cast<bool>(map.erase(key))) fail("Remove");
+        } else if (op < 8) {
+          if (bpt.SetValue(key, ValueOf(key)) != map.emplace(key, ValueOf(key)).second) fail("SetValue");
+        } else {
+          int value = -1;
+          auto hint = bpt.GetValue(key, &value);
+          if (hint.found() != map.contains(key) || (hint.found() && value != ValueOf(key))) fail("GetValue");
+        }
+        if (i % 500 != 0) continue;
+        // a batch of keys of this writer, which may split or merge several leaves at once
+        std::vector<std::pair<hash_t, int> > items;
+        std::vector<hash_t> keys;
+        for (int j = 0; j < 30; ++j) {
+          key += kWriters * (1 + rng() % 3);
+          items.emplace_back(key, ValueOf(key));
+          keys.push_back(key);
+        }
+        size_t count = 0;
+        if (rng() % 2) {
+          for (auto &[k, v] : items) count += map.emplace(k, v).second;
+          if (bpt.InsertBatch(items) != count) fail("InsertBatch");
+        } else {
+          for (auto k : keys) count += map.erase(k);
+          if (bpt.RemoveBatch(keys) != count) fail("RemoveBatch");
+        }
+      }
+    });
+  }
+  for (int r = 0; r < kReaders; ++r) {
+    threads.emplace_back([&, r] {
+      std::mt19937_64 rng(kWriters + r);
+      while (!done && !failed) {
+        auto it = bpt.LowerBound(rng() % (kKeysPerWriter * kWriters));
+        std::optional<hash_t> prev;
+        for (int i = 0; i < 200 && it != bpt.End(); ++i, ++it) {
+          auto key = it.Key();
+          if ((prev && key <= *prev) || it.Value() != ValueOf(key)) {
+            fail("scan");
+            break;
+          }
+          prev = key;
+        }
+      }
+    });
+  }
+  for (int w = 0; w < kWriters; ++w) threads[w].join();
+  done = true;
+  for (size_t i = kWriters; i < threads.size(); ++i) threads[i].join();
+  if (failed) return false;
+
+  std::map<hash_t, int> all;
+  for (auto &map : expected) all.insert(map.begin(), map.end());
+  auto it = bpt.LowerBound(0);
+  for (auto &[key, value] : all) {
+    if (it == bpt.End() || it.Key() != key || it.Value() != value) {
+      fail("final contents");
+      return false;
+    }
+    ++it;
+  }
+  if (it != bpt.End()) {
+    fail("final contents");
+    return false;
+  }
+  if (!bpt.Validate()) {
+    fail("Validate");
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+int main() {
+  bool ok = true;
+  for (int pinned_levels : {0, 2}) {
+    for (bool cleaner : {false, true}) {
+      ok &= Run(pinned_levels, cleaner);
+    }
+  }
+  std::puts(ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}